@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Corpus entries read straight out of zip and tar archives, and out of
+ * batch testcases.
+ *
+ * The archive is mapped, and a reader thread walks its entries and inflates
+ * them into memory, at most ARCHIVE_QUEUE_DEPTH entries ahead of the decoder.
+ * Stored zip entries and tar entries are not copied at all: they point into
+ * the mapping.
+ *
+ * A batch testcase is several inputs joined by BATCH_SEPARATOR, so that a
+ * fork server build without a persistent loop runs all of them in one exec.
+ * There is no header or length field for mutations to break.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/intreadwrite.h>
+#include <libavutil/mem.h>
+
+#include "fffuzz.h"
+
+#define ARCHIVE_QUEUE_DEPTH 4
+
+#define ZIP_LOCAL_HEADER_SIZE   30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_END_SIZE            22
+#define TAR_BLOCK_SIZE          512
+
+struct archive {
+    enum archive_type type;
+    char *filename;
+    const uint8_t *map;
+    size_t size;
+
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct archive_entry queue[ARCHIVE_QUEUE_DEPTH];
+    int head, nb_queued;
+    int done;       ///< 1 at the end of the archive, <0 on error
+    int stop;       ///< set by archive_close() to stop the reader early
+};
+
+/* hand one entry to the decoder, waiting while the queue is full */
+static int push_entry(struct archive *archive, struct archive_entry *entry)
+{
+    int stop;
+
+    pthread_mutex_lock(&archive->lock);
+    while (archive->nb_queued == ARCHIVE_QUEUE_DEPTH && !archive->stop)
+        pthread_cond_wait(&archive->cond, &archive->lock);
+    stop = archive->stop;
+    if (!stop) {
+        archive->queue[(archive->head + archive->nb_queued) % ARCHIVE_QUEUE_DEPTH] = *entry;
+        archive->nb_queued++;
+        pthread_cond_broadcast(&archive->cond);
+    }
+    pthread_mutex_unlock(&archive->lock);
+
+    if (stop) {
+        archive_entry_free(entry);
+        return -1;
+    }
+    return 0;
+}
+
+static int inflate_entry(struct archive_entry *entry, const uint8_t *src,
+                         size_t src_size, size_t size)
+{
+    z_stream zs;
+    int ret;
+
+    memset(&zs, 0, sizeof(zs));
+    entry->buffer = av_malloc(FFMAX(size, 1));
+    if (!entry->buffer || inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+        return -1;
+    zs.next_in   = (Bytef *)src;
+    zs.avail_in  = src_size;
+    zs.next_out  = entry->buffer;
+    zs.avail_out = size;
+    ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END || zs.total_out != size)
+        return -1;
+    entry->data = entry->buffer;
+    entry->size = size;
+    return 0;
+}
+
+static int read_zip(struct archive *archive)
+{
+    const uint8_t *map = archive->map, *end = NULL;
+    size_t size = archive->size, offset, back;
+    unsigned nb_entries, i;
+
+    /* the end of central directory record is followed by at most a 64k comment */
+    for (back = ZIP_END_SIZE; back <= size && back <= 65535 + ZIP_END_SIZE; back++) {
+        if (AV_RL32(map + size - back) == 0x06054b50) {
+            end = map + size - back;
+            break;
+        }
+    }
+    if (!end) {
+        fprintf(stderr, "Could not find the zip central directory\n");
+        return -1;
+    }
+    nb_entries = AV_RL16(end + 10);
+    offset     = AV_RL32(end + 16);
+
+    for (i = 0; i < nb_entries; i++) {
+        struct archive_entry entry = { 0 };
+        const uint8_t *cd = map + offset, *local;
+        unsigned method, name_len;
+        size_t comp_size, uncomp_size, local_offset;
+
+        if (offset + ZIP_CENTRAL_HEADER_SIZE > size || AV_RL32(cd) != 0x02014b50)
+            return -1;
+        method       = AV_RL16(cd + 10);
+        comp_size    = AV_RL32(cd + 20);
+        uncomp_size  = AV_RL32(cd + 24);
+        name_len     = AV_RL16(cd + 28);
+        local_offset = AV_RL32(cd + 42);
+        offset += ZIP_CENTRAL_HEADER_SIZE + name_len + AV_RL16(cd + 30) + AV_RL16(cd + 32);
+        if (offset > size)
+            return -1;
+
+        /* skip directories */
+        if (name_len && cd[ZIP_CENTRAL_HEADER_SIZE + name_len - 1] == '/')
+            continue;
+        if (local_offset + ZIP_LOCAL_HEADER_SIZE > size ||
+            AV_RL32(map + local_offset) != 0x04034b50)
+            return -1;
+        local = map + local_offset + ZIP_LOCAL_HEADER_SIZE +
+                AV_RL16(map + local_offset + 26) + AV_RL16(map + local_offset + 28);
+        if (local + comp_size > map + size)
+            return -1;
+
+        entry.name = av_malloc(name_len + 1);
+        if (!entry.name)
+            return -1;
+        memcpy(entry.name, cd + ZIP_CENTRAL_HEADER_SIZE, name_len);
+        entry.name[name_len] = 0;
+
+        entry.offset = -1;
+        if (method == 0) {
+            entry.data   = local;
+            entry.size   = comp_size;
+            entry.offset = local - map;
+        } else if (method != 8 || inflate_entry(&entry, local, comp_size, uncomp_size) < 0) {
+            fprintf(stderr, "Skipping zip entry %s (method %u)\n", entry.name, method);
+            archive_entry_free(&entry);
+            continue;
+        }
+        if (push_entry(archive, &entry) < 0)
+            return 0;
+    }
+    return 0;
+}
+
+static size_t tar_number(const uint8_t *field, int len)
+{
+    size_t value = 0;
+    int i;
+
+    /* GNU base-256 for sizes which do not fit in octal */
+    if (field[0] & 0x80) {
+        value = field[0] & 0x7f;
+        for (i = 1; i < len; i++)
+            value = value << 8 | field[i];
+        return value;
+    }
+    for (i = 0; i < len && field[i] == ' '; i++)
+        ;
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; i++)
+        value = value << 3 | (field[i] - '0');
+    return value;
+}
+
+static int read_tar(struct archive *archive)
+{
+    const uint8_t *map = archive->map;
+    size_t size = archive->size, offset = 0;
+    char *long_name = NULL;
+
+    while (offset + TAR_BLOCK_SIZE <= size) {
+        const uint8_t *header = map + offset;
+        struct archive_entry entry = { 0 };
+        size_t entry_size = tar_number(header + 124, 12);
+        char type = header[156];
+
+        if (!header[0])
+            break;  /* end of archive */
+        offset += TAR_BLOCK_SIZE;
+        if (entry_size > size - offset) {
+            av_free(long_name);
+            return -1;
+        }
+
+        if (type == 'L') {
+            /* GNU long name of the next entry */
+            av_free(long_name);
+            long_name = av_malloc(entry_size + 1);
+            if (!long_name)
+                return -1;
+            memcpy(long_name, map + offset, entry_size);
+            long_name[entry_size] = 0;
+        } else if (type == '0' || type == 0) {
+            if (long_name) {
+                entry.name = long_name;
+                long_name  = NULL;
+            } else if (header[345]) {
+                entry.name = av_asprintf("%.155s/%.100s", header + 345, header);
+            } else {
+                entry.name = av_asprintf("%.100s", header);
+            }
+            if (!entry.name)
+                return -1;
+            entry.data   = map + offset;
+            entry.size   = entry_size;
+            entry.offset = offset;
+            if (push_entry(archive, &entry) < 0)
+                return 0;
+        } else {
+            /* directories, links and pax headers */
+            av_freep(&long_name);
+        }
+        offset += FFALIGN(entry_size, TAR_BLOCK_SIZE);
+    }
+    av_free(long_name);
+    return 0;
+}
+
+static int read_batch(struct archive *archive)
+{
+    const uint8_t *map = archive->map, *p = map, *end = map + archive->size;
+    int i;
+
+    for (i = 0; p < end; i++) {
+        struct archive_entry entry = { 0 };
+        const uint8_t *next = memmem(p, end - p, BATCH_SEPARATOR, sizeof(BATCH_SEPARATOR) - 1);
+
+        if (!next)
+            next = end;
+        if (next > p) {
+            entry.name = av_asprintf("%s#%d", archive->filename, i);
+            if (!entry.name)
+                return -1;
+            entry.data   = p;
+            entry.size   = next - p;
+            entry.offset = p - map;
+            if (push_entry(archive, &entry) < 0)
+                return 0;
+        }
+        p = next + (next < end ? sizeof(BATCH_SEPARATOR) - 1 : 0);
+    }
+    return 0;
+}
+
+static void *reader_thread(void *arg)
+{
+    struct archive *archive = arg;
+    int ret;
+
+    switch (archive->type) {
+    case ARCHIVE_ZIP:
+        ret = read_zip(archive);
+        break;
+    case ARCHIVE_TAR:
+        ret = read_tar(archive);
+        break;
+    default:
+        ret = read_batch(archive);
+        break;
+    }
+
+    if (ret < 0)
+        fprintf(stderr, "Archive is corrupt, stopped reading it\n");
+    pthread_mutex_lock(&archive->lock);
+    archive->done = ret < 0 ? -1 : 1;
+    pthread_cond_broadcast(&archive->cond);
+    pthread_mutex_unlock(&archive->lock);
+    return NULL;
+}
+
+struct archive *archive_open(const char *filename, enum archive_type type)
+{
+    struct archive *archive;
+    struct stat st;
+    void *map;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0 || !st.st_size) {
+        fprintf(stderr, "Could not open archive %s\n", filename);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Could not map archive %s\n", filename);
+        return NULL;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    archive = av_mallocz(sizeof(*archive));
+    if (!archive) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    archive->type     = type;
+    archive->filename = av_strdup(filename);
+    archive->map      = map;
+    archive->size     = st.st_size;
+    pthread_mutex_init(&archive->lock, NULL);
+    pthread_cond_init(&archive->cond, NULL);
+    if (pthread_create(&archive->reader, NULL, reader_thread, archive)) {
+        fprintf(stderr, "Could not start the archive reader\n");
+        pthread_mutex_destroy(&archive->lock);
+        pthread_cond_destroy(&archive->cond);
+        munmap(map, st.st_size);
+        av_free(archive->filename);
+        av_free(archive);
+        return NULL;
+    }
+    return archive;
+}
+
+int archive_next(struct archive *archive, struct archive_entry *entry)
+{
+    int ret;
+
+    pthread_mutex_lock(&archive->lock);
+    while (!archive->nb_queued && !archive->done)
+        pthread_cond_wait(&archive->cond, &archive->lock);
+    if (archive->nb_queued) {
+        *entry = archive->queue[archive->head];
+        archive->head = (archive->head + 1) % ARCHIVE_QUEUE_DEPTH;
+        archive->nb_queued--;
+        pthread_cond_broadcast(&archive->cond);
+        ret = 1;
+    } else {
+        ret = archive->done < 0 ? -1 : 0;
+    }
+    pthread_mutex_unlock(&archive->lock);
+    return ret;
+}
+
+void archive_entry_free(struct archive_entry *entry)
+{
+    av_freep(&entry->name);
+    av_freep(&entry->buffer);
+    entry->data   = NULL;
+    entry->size   = 0;
+    entry->offset = -1;
+}
+
+void archive_close(struct archive **archive)
+{
+    struct archive *a = *archive;
+
+    if (!a)
+        return;
+    pthread_mutex_lock(&a->lock);
+    a->stop = 1;
+    pthread_cond_broadcast(&a->cond);
+    pthread_mutex_unlock(&a->lock);
+    pthread_join(a->reader, NULL);
+
+    while (a->nb_queued) {
+        archive_entry_free(&a->queue[a->head]);
+        a->head = (a->head + 1) % ARCHIVE_QUEUE_DEPTH;
+        a->nb_queued--;
+    }
+    pthread_mutex_destroy(&a->lock);
+    pthread_cond_destroy(&a->cond);
+    munmap((void *)a->map, a->size);
+    av_free(a->filename);
+    av_freep(archive);
+}
@@ -1 +1,74 @@
-afl-clang-fast main.c -o fffuzz `pkg-config --libs libswscale libavutil libavcodec libavformat`
+#!/bin/sh
+# usage: ./build.sh [index|coverage|sched|focus [-f format] [-c codec]]
+#
+# index: plain clang build recording the functions each input reaches (-i),
+# against an FFmpeg configured with
+#   --extra-cflags=-fsanitize-coverage=func,trace-pc-guard
+# Also builds fffuzz-impact, which turns the logs into a selection index.
+#
+# coverage: fffuzz-cov with clang source coverage, for coverage.sh, against
+# an FFmpeg configured with
+#   --extra-cflags="-fprofile-instr-generate -fcoverage-mapping"
+#   --extra-ldflags=-fprofile-instr-generate
+#
+# sched: the default build with the pthread functions interposed for
+# deterministic thread scheduling (-D). Not with AFL_USE_ASAN/MSAN/TSAN,
+# whose runtimes intercept them as well.
+#
+# focus: rebuilds the FFmpeg tree in FFMPEG_SRC with afl-clang-fast and an
+# AFL++ allowlist of the files sources.sh finds for the -f/-c pair, so only
+# the targeted demuxer, decoder, parser and DSP code is instrumented, then
+# links fffuzz against it. Run fffuzz with the same -f/-c.
+#
+# The fuzzing builds (focus and the default) also build fffuzz-sync, which
+# shares new queue entries between the AFL instances of a fleet.
+
+SOURCES="main.c minimize.c prof.c stages.c golden.c archive.c funcindex.c writer.c sched.c hugepage.c generate.c encode.c mux.c scale.c resample.c serve.c"
+LIBS="`pkg-config --libs libswscale libswresample libavutil libavcodec libavformat` -lz -lpthread -ldl"
+
+case "$1" in
+index)
+    clang -g -rdynamic -DFFFUZZ_FUNC_INDEX $SOURCES -o fffuzz $LIBS &&
+    clang -O2 impact.c -o fffuzz-impact
+    ;;
+coverage)
+    clang -g -O1 -fprofile-instr-generate -fcoverage-mapping $SOURCES -o fffuzz-cov $LIBS
+    ;;
+focus)
+    shift
+    if [ ! -x "$FFMPEG_SRC/configure" ]; then
+        echo "FFMPEG_SRC has to point at an FFmpeg source tree" >&2
+        exit 1
+    fi
+    src=$(cd "$FFMPEG_SRC" && pwd)
+    prefix=$PWD/ffmpeg-focus
+    # paths relative to the tree, as the FFmpeg Makefiles compile them
+    ./sources.sh "$src" "$@" | sed "s|^$src/||" > fffuzz.allowlist
+    if [ ! -s fffuzz.allowlist ]; then
+        echo "No FFmpeg sources found for $*" >&2
+        exit 1
+    fi
+    echo "Instrumenting $(wc -l < fffuzz.allowlist) FFmpeg files, listed in fffuzz.allowlist"
+    export AFL_LLVM_ALLOWLIST=$PWD/fffuzz.allowlist
+    (cd "$src" &&
+     ./configure --cc=afl-clang-fast --prefix="$prefix" --disable-programs --disable-doc &&
+     make clean && make -j"$(getconf _NPROCESSORS_ONLN)" && make install) || exit 1
+    unset AFL_LLVM_ALLOWLIST
+    afl-clang-fast -rdynamic -I"$prefix/include" $SOURCES -o fffuzz \
+        `PKG_CONFIG_PATH=$prefix/lib/pkgconfig pkg-config --static --libs libswscale libswresample libavutil libavcodec libavformat` \
+        -lz -lpthread -ldl &&
+    clang -O2 sync.c -o fffuzz-sync -lrt
+    ;;
+sched)
+    if [ -n "$AFL_USE_ASAN$AFL_USE_MSAN$AFL_USE_TSAN" ]; then
+        echo "The sanitizer runtimes intercept the pthread functions as well" >&2
+        exit 1
+    fi
+    afl-clang-fast -rdynamic -DFFFUZZ_SCHED $SOURCES -o fffuzz $LIBS &&
+    clang -O2 sync.c -o fffuzz-sync -lrt
+    ;;
+*)
+    afl-clang-fast -rdynamic $SOURCES -o fffuzz $LIBS &&
+    clang -O2 sync.c -o fffuzz-sync -lrt
+    ;;
+esac
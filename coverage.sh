@@ -0,0 +1,89 @@
+#!/bin/sh
+# Replay a fuzzing queue through the coverage build (./build.sh coverage) in
+# parallel shards and render source coverage of the -f/-c target.
+#
+# Every shard runs its share of the queue one input per process, with
+# LLVM_PROFILE_FILE using %m so the processes of a shard merge into one
+# profraw. The shards are merged with llvm-profdata and reported with
+# llvm-cov, restricted to the files sources.sh finds for the target when
+# FFMPEG_SRC points at the FFmpeg tree the build used. With a shared FFmpeg
+# the coverage mapping is in the libraries, so every library the binary
+# loads which has one is passed to llvm-cov as well; each writes its own
+# profraw, %m being per module.
+#
+# usage: coverage.sh queue_dir report_dir [fffuzz options]
+#
+# JOBS sets the number of shards (default: online CPUs), TIMEOUT the seconds
+# per input (default 10), FFFUZZ_COV the binary (default ./fffuzz-cov).
+
+if [ $# -lt 2 ] || [ ! -d "$1" ]; then
+    echo "usage: $0 queue_dir report_dir [fffuzz options]" >&2
+    exit 1
+fi
+
+queue_dir=$1
+report_dir=$2
+shift 2
+fffuzz=${FFFUZZ_COV:-./fffuzz-cov}
+jobs=${JOBS:-$(getconf _NPROCESSORS_ONLN)}
+timeout=${TIMEOUT:-10}
+work=$report_dir/profraw
+
+mkdir -p "$work" || exit 1
+rm -f "$work"/*.profraw "$work"/shard.*
+
+# deal the queue out round-robin, AFL state files excluded
+find "$queue_dir" -maxdepth 1 -type f ! -name '.*' | sort |
+    awk -v jobs="$jobs" -v work="$work" '{ print > (work "/shard." (NR % jobs)) }'
+
+shard_count=$(ls "$work"/shard.* 2>/dev/null | wc -l)
+if [ "$shard_count" -eq 0 ]; then
+    echo "$queue_dir is empty" >&2
+    exit 1
+fi
+echo "Replaying $(cat "$work"/shard.* | wc -l) inputs in $shard_count shards"
+
+for list in "$work"/shard.*; do
+    shard=${list##*.}
+    (
+        while read -r input; do
+            # crashing and hanging inputs lose their counts, like in afl-cov
+            LLVM_PROFILE_FILE="$work/$shard-%m.profraw" \
+                timeout "$timeout" "$fffuzz" "$@" "$input" /dev/null >/dev/null 2>&1
+        done < "$list"
+    ) &
+done
+wait
+
+llvm-profdata merge -sparse "$work"/*.profraw -o "$report_dir/fffuzz.profdata" || exit 1
+
+# parse -f/-c out of the fffuzz options to pick the target files
+target=
+while [ $# -gt 1 ]; do
+    case "$1" in
+    -f|-c) target="$target $1 $2" ;;
+    esac
+    shift 2
+done
+sources=
+if [ -n "$FFMPEG_SRC" ] && [ -n "$target" ]; then
+    sources=$("$(dirname "$0")/sources.sh" "$FFMPEG_SRC" $target)
+    if [ -z "$sources" ]; then
+        echo "No sources found for$target in $FFMPEG_SRC, reporting all files" >&2
+    fi
+fi
+
+objects=
+for lib in $(ldd "$fffuzz" 2>/dev/null | awk '$3 ~ /^\// { print $3 }'); do
+    if grep -q __llvm_covmap "$lib"; then
+        objects="$objects -object $lib"
+    fi
+done
+
+llvm-cov report "$fffuzz" $objects -instr-profile="$report_dir/fffuzz.profdata" $sources \
+    > "$report_dir/report.txt" || exit 1
+llvm-cov show "$fffuzz" $objects -instr-profile="$report_dir/fffuzz.profdata" \
+    -format=html -output-dir="$report_dir/html" $sources || exit 1
+
+tail -n 1 "$report_dir/report.txt"
+echo "Per-file report in $report_dir/report.txt, sources in $report_dir/html/index.html"
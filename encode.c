@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Encoder fuzzing from raw frames in the input (-M encode -c encoder).
+ *
+ * The input starts with an ENCODE_HEADER_SIZE byte header:
+ *
+ *   0  width - 1, 16 bit LE, modulo ENCODE_MAX_SIZE     (video)
+ *   2  height - 1, 16 bit LE, modulo ENCODE_MAX_SIZE    (video)
+ *   4  index into the encoder's pixel or sample formats
+ *   5  channels - 1, modulo 8                           (audio)
+ *   6  index into the encoder's sample rates            (audio)
+ *   7  length of the encoder options which follow, as key=value:key=value
+ *
+ * and goes on with raw frames, packed as rawvideo has them or as
+ * av_samples_fill_arrays() expects them, up to the last complete one. An
+ * input without a complete frame is turned down before anything is
+ * allocated for its frames.
+ *
+ * Every input gets a new encoder context, as a closed one cannot be opened
+ * again. Frames come round-robin from a pool which is only reallocated when
+ * the frame parameters change, so persistent mode iterations do not
+ * allocate per frame.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/file.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/intreadwrite.h>
+#include <libavutil/samplefmt.h>
+#include <libavutil/time.h>
+#include <libavcodec/avcodec.h>
+
+#include "fffuzz.h"
+
+#define ENCODE_HEADER_SIZE 8
+#define ENCODE_MAX_SIZE    4096
+#define ENCODE_POOL_SIZE   4
+#define ENCODE_MAX_CHANNELS 8
+
+struct frame_params {
+    int width, height;
+    int format;
+    int channels;
+    int nb_samples;
+};
+
+static const int default_sample_rates[] = {
+    8000, 11025, 16000, 22050, 32000, 44100, 48000, 96000, 0
+};
+
+static AVCodec *enc;
+static AVCodecContext *enc_ctx;
+static AVFrame *pool[ENCODE_POOL_SIZE];
+static struct frame_params pool_params;
+
+/* the n-th entry of the encoder's lists, modulo their length */
+static enum AVPixelFormat pick_pix_fmt(const enum AVPixelFormat *list, int n)
+{
+    int count = 0;
+
+    while (list && list[count] != AV_PIX_FMT_NONE)
+        count++;
+    return count ? list[n % count] : AV_PIX_FMT_YUV420P;
+}
+
+static enum AVSampleFormat pick_sample_fmt(const enum AVSampleFormat *list, int n)
+{
+    int count = 0;
+
+    while (list && list[count] != AV_SAMPLE_FMT_NONE)
+        count++;
+    return count ? list[n % count] : AV_SAMPLE_FMT_S16;
+}
+
+static int pick_sample_rate(const int *list, int n)
+{
+    int count = 0;
+
+    if (!list)
+        list = default_sample_rates;
+    while (list[count])
+        count++;
+    return list[n % count];
+}
+
+static int alloc_pool(const struct frame_params *params)
+{
+    int i;
+
+    if (pool[0] && !memcmp(params, &pool_params, sizeof(*params)))
+        return 0;
+    for (i = 0; i < ENCODE_POOL_SIZE; i++) {
+        av_frame_free(&pool[i]);
+        pool[i] = av_frame_alloc();
+        if (!pool[i])
+            return AVERROR(ENOMEM);
+        pool[i]->format         = params->format;
+        pool[i]->width          = params->width;
+        pool[i]->height         = params->height;
+        pool[i]->channels       = params->channels;
+        pool[i]->channel_layout = av_get_default_channel_layout(params->channels);
+        pool[i]->nb_samples     = params->nb_samples;
+        if (av_frame_get_buffer(pool[i], 32) < 0) {
+            av_frame_free(&pool[i]);
+            return AVERROR(ENOMEM);
+        }
+    }
+    pool_params = *params;
+    return 0;
+}
+
+static int encode_frame(AVFrame *frame, FILE *dst_file, int *nb_packets, int64_t *nb_bytes)
+{
+    AVPacket pkt;
+    int got_packet, ret;
+
+    /* without a frame, drain all the delayed packets */
+    do {
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        if (enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO)
+            ret = avcodec_encode_video2(enc_ctx, &pkt, frame, &got_packet);
+        else
+            ret = avcodec_encode_audio2(enc_ctx, &pkt, frame, &got_packet);
+        if (ret < 0) {
+            fprintf(stderr, "Error encoding frame (%s)\n", av_err2str(ret));
+            return ret;
+        }
+        if (!got_packet)
+            return 0;
+        fwrite(pkt.data, 1, pkt.size, dst_file);
+        *nb_packets += 1;
+        *nb_bytes += pkt.size;
+        av_packet_unref(&pkt);
+    } while (!frame);
+    return 0;
+}
+
+/* the frame parameters of the header, but the samples of an audio frame */
+static void read_params(const uint8_t *header, struct frame_params *params)
+{
+    memset(params, 0, sizeof(*params));
+    if (enc->type == AVMEDIA_TYPE_VIDEO) {
+        params->width  = 1 + AV_RL16(header)     % ENCODE_MAX_SIZE;
+        params->height = 1 + AV_RL16(header + 2) % ENCODE_MAX_SIZE;
+        params->format = pick_pix_fmt(enc->pix_fmts, header[4]);
+    } else {
+        params->format   = pick_sample_fmt(enc->sample_fmts, header[4]);
+        params->channels = 1 + header[5] % ENCODE_MAX_CHANNELS;
+    }
+}
+
+/* bytes of one raw frame in the input, 0 if params make none */
+static size_t raw_frame_size(const struct frame_params *params)
+{
+    int size;
+
+    if (enc->type == AVMEDIA_TYPE_VIDEO)
+        size = av_image_get_buffer_size(params->format, params->width, params->height, 1);
+    else
+        size = av_samples_get_buffer_size(NULL, params->channels, params->nb_samples,
+                                          params->format, 1);
+    return FFMAX(size, 0);
+}
+
+static int open_encoder(const uint8_t *header, const uint8_t *options, int options_size,
+                        struct frame_params *params)
+{
+    AVDictionary *opts = NULL;
+    char *options_string;
+    int ret;
+
+    enc_ctx = avcodec_alloc_context3(enc);
+    if (!enc_ctx)
+        return -1;
+
+    if (enc->type == AVMEDIA_TYPE_VIDEO) {
+        enc_ctx->width     = params->width;
+        enc_ctx->height    = params->height;
+        enc_ctx->pix_fmt   = params->format;
+        enc_ctx->time_base = (AVRational){ 1, 25 };
+    } else {
+        enc_ctx->sample_fmt     = params->format;
+        enc_ctx->channels       = params->channels;
+        enc_ctx->channel_layout = av_get_default_channel_layout(params->channels);
+        enc_ctx->sample_rate    = pick_sample_rate(enc->supported_samplerates, header[6]);
+        enc_ctx->time_base      = (AVRational){ 1, enc_ctx->sample_rate };
+    }
+
+    av_dict_set(&opts, "strict", "-2", 0);
+    options_string = av_strndup((const char *)options, options_size);
+    /* options which do not parse are left out, like unknown ones */
+    if (options_string)
+        av_dict_parse_string(&opts, options_string, "=", ":", 0);
+    av_free(options_string);
+    ret = avcodec_open2(enc_ctx, enc, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        fprintf(stderr, "Could not open encoder %s (%s)\n", enc->name, av_err2str(ret));
+        return ret;
+    }
+
+    if (enc->type == AVMEDIA_TYPE_AUDIO)
+        params->nb_samples = enc_ctx->frame_size ? enc_ctx->frame_size : 1024;
+    return 0;
+}
+
+int encode_input(const char *src_filename, const char *encoder, const char *dst_filename,
+                 FILE *report)
+{
+    struct frame_params params;
+    uint8_t *data = NULL, *src_data[ENCODE_MAX_CHANNELS];
+    int src_linesize[4];
+    size_t size = 0, pos, frame_size;
+    FILE *dst_file = NULL;
+    int nb_frames = 0, nb_packets = 0, options_size, ret = 1;
+    int64_t nb_bytes = 0, start, elapsed;
+
+    if (!enc) {
+        enc = avcodec_find_encoder_by_name(encoder);
+        if (!enc || (enc->type != AVMEDIA_TYPE_VIDEO && enc->type != AVMEDIA_TYPE_AUDIO)) {
+            fprintf(stderr, "Could not find video or audio encoder %s\n", encoder);
+            enc = NULL;
+            return 1;
+        }
+    }
+
+    if (av_file_map(src_filename, &data, &size, 0, NULL) < 0) {
+        fprintf(stderr, "Could not read source file %s\n", src_filename);
+        return 1;
+    }
+    if (size < ENCODE_HEADER_SIZE) {
+        fprintf(stderr, "Input %s is shorter than the encoder header\n", src_filename);
+        goto end;
+    }
+    options_size = FFMIN(data[7], size - ENCODE_HEADER_SIZE);
+    pos = ENCODE_HEADER_SIZE + options_size;
+
+    read_params(data, &params);
+    /* a video frame is sized by the header alone, so a short input is turned
+     * down before the encoder and up to 4096x4096 frames are set up for it */
+    if (enc->type == AVMEDIA_TYPE_VIDEO &&
+        (!(frame_size = raw_frame_size(&params)) || size - pos < frame_size)) {
+        fprintf(stderr, "Input %s holds no complete frame\n", src_filename);
+        goto end;
+    }
+    if (open_encoder(data, data + ENCODE_HEADER_SIZE, options_size, &params) < 0)
+        goto end;
+    /* an audio frame has the encoder's frame size */
+    frame_size = raw_frame_size(&params);
+    if (!frame_size || size - pos < frame_size) {
+        fprintf(stderr, "Input %s holds no complete frame\n", src_filename);
+        goto end;
+    }
+    if (alloc_pool(&params) < 0) {
+        fprintf(stderr, "Could not allocate frames\n");
+        goto end;
+    }
+
+    dst_file = fopen(dst_filename, "wb");
+    if (!dst_file) {
+        fprintf(stderr, "Could not open destination file %s\n", dst_filename);
+        goto end;
+    }
+
+    if (enc->type == AVMEDIA_TYPE_VIDEO)
+        printf("Encoding %dx%d %s frames of %zu bytes with %s\n", params.width, params.height,
+               av_get_pix_fmt_name(params.format), frame_size, enc->name);
+    else
+        printf("Encoding %d channel %d Hz %s frames of %d samples with %s\n",
+               params.channels, enc_ctx->sample_rate, av_get_sample_fmt_name(params.format),
+               params.nb_samples, enc->name);
+
+    start = av_gettime_relative();
+    for (; size - pos >= frame_size; pos += frame_size) {
+        AVFrame *frame = pool[nb_frames % ENCODE_POOL_SIZE];
+
+        /* the encoder may still hold a reference from the last round */
+        if (av_frame_make_writable(frame) < 0)
+            goto end;
+        if (enc->type == AVMEDIA_TYPE_VIDEO) {
+            av_image_fill_arrays(src_data, src_linesize, data + pos, params.format,
+                                 params.width, params.height, 1);
+            av_image_copy(frame->data, frame->linesize, (const uint8_t **)src_data,
+                          src_linesize, params.format, params.width, params.height);
+            frame->pts = nb_frames;
+        } else {
+            av_samples_fill_arrays(src_data, NULL, data + pos, params.channels,
+                                   params.nb_samples, params.format, 1);
+            av_samples_copy(frame->extended_data, src_data, 0, 0, params.nb_samples,
+                            params.channels, params.format);
+            frame->pts = (int64_t)nb_frames * params.nb_samples;
+        }
+        if (encode_frame(frame, dst_file, &nb_packets, &nb_bytes) < 0)
+            goto end;
+        nb_frames++;
+    }
+    if (encode_frame(NULL, dst_file, &nb_packets, &nb_bytes) < 0)
+        goto end;
+    elapsed = FFMAX(av_gettime_relative() - start, 1);
+
+    printf("Encoded %d frames into %d packets of %"PRId64" bytes in %"PRId64" us,"
+           " %.1f frames/s, %.1f MB/s of raw input\n",
+           nb_frames, nb_packets, nb_bytes, elapsed, nb_frames * 1e6 / elapsed,
+           (double)nb_frames * frame_size / elapsed);
+    if (report)
+        fprintf(report, "encode:%s encoder:%s frames:%d packets:%d bytes:%"PRId64
+                " us:%"PRId64" fps:%.1f\n", src_filename, enc->name, nb_frames,
+                nb_packets, nb_bytes, elapsed, nb_frames * 1e6 / elapsed);
+    ret = 0;
+
+end:
+    avcodec_free_context(&enc_ctx);
+    if (dst_file)
+        fclose(dst_file);
+    av_file_unmap(data, size);
+    return ret;
+}
+
+void encode_close(void)
+{
+    int i;
+
+    for (i = 0; i < ENCODE_POOL_SIZE; i++)
+        av_frame_free(&pool[i]);
+}
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Functions shared between the harness source files.
+ */
+#ifndef FFFUZZ_H
+#define FFFUZZ_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <libavcodec/avcodec.h>
+
+/* main.c */
+
+#define MEMORY_IO_BUFFER_SIZE 32768
+
+/* input read from memory instead of a file */
+struct memory_input {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+};
+
+/** AVIOContext read and seek callbacks on a struct memory_input. */
+int memory_read(void *opaque, uint8_t *buf, int buf_size);
+int64_t memory_seek(void *opaque, int64_t offset, int whence);
+
+/**
+ * Demux and decode one input with the options given on the command line.
+ *
+ * @return 0 on success, 1 if the input could not be set up for decoding
+ */
+int decode_input(const char *src_filename, const char *dst_filename);
+
+/**
+ * Like decode_input(), but demux the input from data instead of a file.
+ * src_filename only names the input in messages and reports.
+ */
+int decode_input_data(const char *src_filename, const uint8_t *data, size_t size,
+                      const char *dst_filename);
+
+/* minimize.c */
+
+enum minimize_objective {
+    MINIMIZE_CPU,   ///< keep the user+system CPU time of a decode
+    MINIMIZE_RSS,   ///< keep the peak resident set size of a decode
+};
+
+/**
+ * Shrink src_filename at demuxer packet boundaries into dst_filename,
+ * keeping only cuts that preserve most of the objective.
+ *
+ * @return 0 on success, 1 on error
+ */
+int minimize_input(const char *src_filename, const char *dst_filename,
+                   const char *format, enum minimize_objective objective);
+
+/* encode.c */
+
+/**
+ * Encode the raw frames in src_filename with encoder, writing the packets
+ * to dst_filename, and print the throughput, also to report if not NULL.
+ *
+ * @return 0 on success, 1 if the input could not be encoded
+ */
+int encode_input(const char *src_filename, const char *encoder, const char *dst_filename,
+                 FILE *report);
+
+/** Free the frames kept between inputs. */
+void encode_close(void);
+
+/* generate.c */
+
+/**
+ * Encode and mux the benchmark corpus of seed into dirname, with a manifest
+ * of the -f and -c options of every input.
+ *
+ * @return 0 on success, 1 on error or if any input failed to generate
+ */
+int generate_corpus(uint64_t seed, const char *dirname);
+
+/* mux.c */
+
+/**
+ * Mux the streams and packets described by src_filename with muxer into
+ * memory, write the result to dst_filename and print the throughput, also
+ * to report if not NULL. With roundtrip, demux the result again.
+ *
+ * @return 0 on success, 1 if the muxer could not be set up
+ */
+int mux_input(const char *src_filename, const char *muxer, int roundtrip,
+              const char *dst_filename, FILE *report);
+
+/* prof.c */
+
+/** Install the SIGPROF handler which counts sampled PCs. */
+int profile_init(void);
+
+/** Start sampling the calling process every PROFILE_INTERVAL_US of CPU time. */
+void profile_start(void);
+
+void profile_stop(void);
+
+/** Write the samples of all iterations so far as a flat profile by function. */
+int profile_write(const char *filename);
+
+/* stages.c */
+
+enum stage {
+    STAGE_NONE = -1,
+    STAGE_OPEN,     ///< opening the input and the decoder
+    STAGE_PROBE,    ///< avformat_find_stream_info()
+    STAGE_DECODE,   ///< demuxing and decoding
+    STAGE_OUTPUT,   ///< printing, copying and writing decoded frames
+    STAGE_NB
+};
+
+/** Open the hardware counters and start charging time to stages. */
+int stage_init(void);
+
+/**
+ * Charge the time and counters since the last switch to the current stage
+ * and make stage the current one. Does nothing unless stage_init() was called.
+ *
+ * @return the stage which was current before
+ */
+enum stage stage_enter(enum stage stage);
+
+/** Print the totals per stage of the input just done and add them to the run. */
+void stage_report_input(FILE *report, const char *name);
+
+/** Print the totals per stage of all inputs so far. */
+void stage_report_run(FILE *report);
+
+/* golden.c */
+
+/**
+ * Map the golden database for comparing, or remember it for updating.
+ * A missing database is treated as empty.
+ */
+int golden_open(const char *filename, int update_database);
+
+/**
+ * Hash the input bytes into the key of the input about to be decoded,
+ * from data if it is not NULL, else from src_filename.
+ */
+int golden_begin_input(const char *src_filename, const uint8_t *data, size_t size);
+
+uint64_t golden_hash_frame(const AVFrame *frame, enum AVMediaType type);
+uint64_t golden_hash_subtitle(const AVSubtitle *sub);
+uint64_t golden_hash_data(const uint8_t *data, size_t size);
+
+/** Append the hash of the next output frame of the current input. */
+int golden_add_frame(uint64_t hash);
+
+/**
+ * Start nb_threads threads hashing the frames passed to golden_queue_frame().
+ */
+int golden_start_threads(int nb_threads);
+
+/**
+ * Hash the next output frame of the current input, on a hash thread if
+ * started. Subtitles are hashed with golden_add_frame() directly, an input
+ * never mixes them with frames.
+ */
+int golden_queue_frame(const AVFrame *frame, enum AVMediaType type);
+
+/**
+ * Compare the current input against the database and print the result, or
+ * queue it for the database update.
+ *
+ * @return 0 on match, 1 if the output changed or the input is new
+ */
+int golden_end_input(const char *src_filename);
+
+/**
+ * Merge queued results into the database when updating.
+ *
+ * @return 0 if all inputs matched, 1 if some did not, <0 on error
+ */
+int golden_close(void);
+
+/* archive.c */
+
+enum archive_type {
+    ARCHIVE_ZIP,    ///< stored or deflated entries, no ZIP64
+    ARCHIVE_TAR,    ///< uncompressed ustar or GNU tar
+    ARCHIVE_BATCH,  ///< inputs joined by BATCH_SEPARATOR
+};
+
+#define BATCH_SEPARATOR "--FFBATCH--"
+
+struct archive;
+
+struct archive_entry {
+    char *name;
+    const uint8_t *data;
+    size_t size;
+    uint8_t *buffer;    ///< decompressed data, NULL if data points into the archive
+    int64_t offset;     ///< of data in the archive file, -1 if decompressed
+};
+
+/**
+ * Map an archive and start reading its entries on a separate thread, which
+ * decompresses a few entries ahead of the caller.
+ */
+struct archive *archive_open(const char *filename, enum archive_type type);
+
+/**
+ * Wait for the next regular file in the archive.
+ *
+ * @return 1 if entry was filled, 0 at the end of the archive, <0 on error
+ */
+int archive_next(struct archive *archive, struct archive_entry *entry);
+
+void archive_entry_free(struct archive_entry *entry);
+
+void archive_close(struct archive **archive);
+
+/* funcindex.c */
+
+/**
+ * Open the log of the functions each input reaches, appending to it.
+ * Fails unless built with -DFFFUZZ_FUNC_INDEX.
+ */
+int func_index_open(const char *filename);
+
+void func_index_begin_input(void);
+
+/**
+ * Write the functions reached since func_index_begin_input() to the log.
+ */
+void func_index_end_input(const char *src_filename);
+
+void func_index_close(void);
+
+/* writer.c */
+
+struct writer;
+
+/**
+ * Start a writer thread appending raw output to fd, from its current offset.
+ */
+struct writer *writer_open(int fd);
+
+/**
+ * Queue a new reference to frame for writing, waiting while the writer is
+ * WRITER_DEPTH frames behind.
+ *
+ * @return 0, or <0 if the frame could not be queued or an earlier write failed
+ */
+int writer_write_frame(struct writer *writer, const AVFrame *frame, enum AVMediaType type);
+
+/**
+ * Wait for the queued frames to be written and stop the writer.
+ *
+ * @return 0, or <0 if any write failed
+ */
+int writer_close(struct writer **writer);
+
+/* scale.c */
+
+/**
+ * Scale the image described by src_filename and write the result to
+ * dst_filename. With benchmark, scale it repeatedly and print the
+ * megapixels per second, also to report if not NULL.
+ *
+ * @return 0 on success, 1 if the conversion could not be set up
+ */
+int scale_input(const char *src_filename, int benchmark, const char *dst_filename,
+                FILE *report);
+
+/** Free the cached scaler. */
+void scale_close(void);
+
+/* resample.c */
+
+#define RESAMPLE_TRAILER_SIZE 4
+
+/**
+ * Resample to spec, "rate:layout:format" as in 44100:stereo:s16.
+ *
+ * @return 0, or <0 if spec does not parse
+ */
+int resample_set_output(const char *spec);
+
+/** Resample the next input to the output picked by options. */
+void resample_pick_output(const uint8_t options[RESAMPLE_TRAILER_SIZE]);
+
+/**
+ * Resample frame with the cached resampler and write the samples to
+ * dst_file, each plane in turn.
+ *
+ * @return 0, or <0 if the resampler could not be set up or failed
+ */
+int resample_frame(const AVFrame *frame, FILE *dst_file);
+
+/**
+ * Drain the resampler into dst_file (if not NULL) and print the samples per
+ * second of the input, also to report if not NULL.
+ */
+void resample_end_input(const char *src_filename, FILE *dst_file, FILE *report);
+
+/** Free the cached resampler. */
+void resample_close(void);
+
+/* serve.c */
+
+/**
+ * Decode one job: data, size bytes named name, into dst_filename, with the
+ * options the client sent.
+ *
+ * @return 0 on success, as decode_input_data()
+ */
+typedef int (*serve_fn)(const char *name, const uint8_t *data, size_t size,
+                        const char *dst_filename, AVDictionary *options);
+
+/**
+ * Listen on socket_path and run the jobs sent to it with job, on nb_workers
+ * forked workers, until SIGINT or SIGTERM. Jobs without an output file write
+ * to dst_filename.<worker>.
+ *
+ * @return 0 when stopped, 1 if serving failed
+ */
+int serve(const char *socket_path, int nb_workers, const char *dst_filename, serve_fn job);
+
+/* sched.c */
+
+/**
+ * Make the calling (main) thread the first scheduled thread. Fails unless
+ * built with ./build.sh sched (-DFFFUZZ_SCHED).
+ */
+int sched_init(void);
+
+/**
+ * Seed the schedule of the next input, and schedule the threads, mutexes
+ * and condition variables created until sched_end().
+ */
+void sched_begin(uint64_t seed);
+void sched_end(void);
+
+/* hugepage.c */
+
+/** Check which kind of 2 MB pages can be mapped and say so. */
+int huge_init(void);
+
+/**
+ * AVCodecContext.get_buffer2 handing out video frames from the hugepage
+ * pool. Other frames come from avcodec_default_get_buffer2().
+ */
+int huge_get_buffer2(AVCodecContext *avctx, AVFrame *frame, int flags);
+
+/**
+ * Like av_image_alloc() with align 1, in a staging buffer which is kept for
+ * the next call instead of being freed.
+ */
+int huge_image_alloc(uint8_t *data[4], int linesize[4], int width, int height,
+                     enum AVPixelFormat pix_fmt);
+
+/** Print the number of blocks mapped by kind and reused. */
+void huge_report(FILE *report);
+
+#endif /* FFFUZZ_H */
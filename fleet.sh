@@ -0,0 +1,148 @@
+#!/bin/sh
+# Run a fleet of AFL instances of fffuzz, each placed on one NUMA node in
+# its own cgroup v2 group instead of under AFL's -m (RLIMIT_AS).
+#
+# Instances are dealt round-robin over the nodes. The group of an instance
+# gets the node's CPUs and only its memory (cpuset.cpus, cpuset.mems), so the
+# fuzzer, the target and its decoder threads stay on the node and frames,
+# including the -l huge pool, are allocated there. memory.max and cpu.max
+# cap every instance, so one memory-hungry decoder is OOM-killed in its own
+# group instead of starving the others. AFL reports such a kill as a crash;
+# triage.sh reruns it without the limit.
+#
+# usage: fleet.sh instances corpus_dir out_dir [fffuzz options]
+#
+# NODES lists the nodes to use (default: all online), MEMORY_MAX the memory
+# per instance (default 2G), CPU_MAX its cpu.max (default one CPU),
+# CGROUP the parent group (default /sys/fs/cgroup/fffuzz), HUGEPAGES the
+# 2 MB pages to reserve per node for -l huge, FFFUZZ the binary (default
+# ./fffuzz). With SYNC set to a shared memory name, every instance gets its
+# own output directory and a fffuzz-sync helper on that log instead of
+# scanning the queues of all the others.
+
+# test fails on a non-numeric instances too
+if [ $# -lt 3 ] || ! [ "$1" -gt 0 ] 2>/dev/null || [ ! -d "$2" ]; then
+    echo "usage: $0 instances corpus_dir out_dir [fffuzz options]" >&2
+    exit 1
+fi
+
+instances=$1
+corpus_dir=$2
+out_dir=$3
+shift 3
+fffuzz=${FFFUZZ:-./fffuzz}
+sync=${FFFUZZ_SYNC:-./fffuzz-sync}
+memory_max=${MEMORY_MAX:-2G}
+cpu_max=${CPU_MAX:-100000 100000}
+cgroup=${CGROUP:-/sys/fs/cgroup/fffuzz}
+node_dir=/sys/devices/system/node
+
+# "0-3,8-11" to "0 1 2 3 8 9 10 11"
+expand_list() {
+    echo "$1" | tr ',' '\n' | awk -F- '{ for (i = $1; i <= ($2 == "" ? $1 : $2); i++) print i }' |
+        tr '\n' ' '
+}
+
+nodes=${NODES:-$(expand_list "$(cat $node_dir/online 2>/dev/null || echo 0)")}
+nb_nodes=$(echo $nodes | wc -w)
+
+# enable the controllers in the subtree of group and of all its parents, root first
+enable_controllers() {
+    if [ -f "$(dirname "$1")/cgroup.controllers" ]; then
+        enable_controllers "$(dirname "$1")" || return 1
+    fi
+    echo "+cpu +cpuset +memory" > "$1/cgroup.subtree_control"
+}
+
+# the closest existing group, then the root of its hierarchy
+root=$(dirname "$cgroup")
+while [ ! -f "$root/cgroup.controllers" ] && [ "$root" != / ]; do
+    root=$(dirname "$root")
+done
+if [ ! -f "$root/cgroup.controllers" ]; then
+    echo "$(dirname "$cgroup") is not in a cgroup v2 hierarchy" >&2
+    exit 1
+fi
+while [ -f "$(dirname "$root")/cgroup.controllers" ]; do
+    root=$(dirname "$root")
+done
+for controller in cpu cpuset memory; do
+    if ! grep -qw $controller "$root/cgroup.controllers"; then
+        echo "The $controller controller is not available in $root" >&2
+        exit 1
+    fi
+done
+mkdir -p "$cgroup" "$out_dir" || exit 1
+enable_controllers "$cgroup" || exit 1
+
+if [ -n "$HUGEPAGES" ]; then
+    for node in $nodes; do
+        echo "$HUGEPAGES" > $node_dir/node$node/hugepages/hugepages-2048kB/nr_hugepages
+        echo "node$node: $(cat $node_dir/node$node/hugepages/hugepages-2048kB/nr_hugepages) huge pages"
+    done
+fi
+
+if [ -n "$SYNC" ]; then
+    "$sync" remove "$SYNC" 2>/dev/null
+    "$sync" init "$SYNC" 1024 || exit 1
+fi
+
+pids=
+groups=
+# stop [status]: exits with status, 0 by default
+stop() {
+    kill $pids 2>/dev/null
+    wait
+    # a group can only go once its processes are gone
+    for group in $groups; do
+        rmdir "$group"
+    done
+    [ -n "$SYNC" ] && "$sync" remove "$SYNC"
+    exit ${1:-0}
+}
+trap 'stop 130' INT
+trap 'stop 143' TERM
+
+i=0
+while [ $i -lt "$instances" ]; do
+    node=$(echo $nodes | cut -d' ' -f$((i % nb_nodes + 1)))
+    if [ $i -eq 0 ]; then
+        name=main
+        role="-M $name"
+    else
+        name=node$node-$i
+        role="-S $name"
+    fi
+    group=$cgroup/$name
+    mkdir -p "$group" || stop 1
+    groups="$groups $group"
+    cat $node_dir/node$node/cpulist > "$group/cpuset.cpus" &&
+    echo "$node" > "$group/cpuset.mems" &&
+    echo "$memory_max" > "$group/memory.max" &&
+    echo "$cpu_max" > "$group/cpu.max" || stop 1
+    # only there with swap accounting
+    [ -f "$group/memory.swap.max" ] && echo 0 > "$group/memory.swap.max"
+
+    instance_out=$out_dir
+    if [ -n "$SYNC" ]; then
+        instance_out=$out_dir/$name
+        mkdir -p "$instance_out" || stop 1
+    fi
+
+    # enter the group first, so afl-fuzz and all it forks start in it; the
+    # group's cpuset replaces AFL's binding to a single core
+    sh -c 'echo $$ > "$0/cgroup.procs" && exec "$@"' "$group" \
+        env AFL_NO_AFFINITY=1 afl-fuzz -i "$corpus_dir" -o "$instance_out" $role -m none \
+        -- "$fffuzz" "$@" @@ /dev/null > "$out_dir/$name.log" 2>&1 &
+    pids="$pids $!"
+    if [ -n "$SYNC" ]; then
+        sh -c 'echo $$ > "$0/cgroup.procs" && exec "$@"' "$group" \
+            "$sync" run "$SYNC" "$instance_out" "$name" >> "$out_dir/$name.log" 2>&1 &
+        pids="$pids $!"
+    fi
+    echo "$name on node $node (CPUs $(cat "$group/cpuset.cpus.effective")), log in $out_dir/$name.log"
+    i=$((i + 1))
+done
+
+wait
+stop
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Functions reached by each input, for change-impact test selection.
+ *
+ * Needs FFmpeg built with -fsanitize-coverage=func,trace-pc-guard and the
+ * harness built with -DFFFUZZ_FUNC_INDEX (./build.sh index). Every function
+ * entry has a guard; the first call of a function for an input records the
+ * PC and clears the guard, so later calls cost one load and a branch. The
+ * guards hit are re-armed before the next input.
+ *
+ * The log has one "module <id> <path>" line the first time a module shows
+ * up, and one "<input>\t<id>:<offset> ..." line per input, with offsets into
+ * the module so that fffuzz-impact can symbolise them with addr2line.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fffuzz.h"
+
+#define MAX_MODULES 64
+
+static FILE *index_log;
+
+static uint32_t **guards;   ///< every guard, by id - 1
+static uintptr_t *hit_pcs;  ///< first PC seen in each function hit
+static uint32_t *hit_ids;   ///< guard id of each function hit
+static int *hit_modules;
+static uint32_t nb_guards, nb_hits;
+
+static const char *modules[MAX_MODULES];
+static int nb_modules;
+
+#ifdef FFFUZZ_FUNC_INDEX
+void __sanitizer_cov_trace_pc_guard_init(uint32_t *start, uint32_t *stop)
+{
+    uint32_t n = stop - start, i;
+
+    if (!n || *start)
+        return;
+    /* modules are loaded before main(), single threaded */
+    guards     = realloc(guards, (nb_guards + n) * sizeof(*guards));
+    hit_pcs    = realloc(hit_pcs, (nb_guards + n) * sizeof(*hit_pcs));
+    hit_ids    = realloc(hit_ids, (nb_guards + n) * sizeof(*hit_ids));
+    hit_modules = realloc(hit_modules, (nb_guards + n) * sizeof(*hit_modules));
+    if (!guards || !hit_pcs || !hit_ids || !hit_modules)
+        abort();
+    for (i = 0; i < n; i++) {
+        guards[nb_guards] = &start[i];
+        start[i] = ++nb_guards;
+    }
+}
+
+void __sanitizer_cov_trace_pc_guard(uint32_t *guard)
+{
+    uint32_t id = __atomic_exchange_n(guard, 0, __ATOMIC_RELAXED), hit;
+
+    if (!id)
+        return;
+    hit = __atomic_fetch_add(&nb_hits, 1, __ATOMIC_RELAXED);
+    hit_pcs[hit] = (uintptr_t)__builtin_return_address(0);
+    hit_ids[hit] = id;
+}
+#endif
+
+int func_index_open(const char *filename)
+{
+#ifdef FFFUZZ_FUNC_INDEX
+    index_log = fopen(filename, "a");
+    if (!index_log) {
+        fprintf(stderr, "Could not open function index log %s\n", filename);
+        return -1;
+    }
+    return 0;
+#else
+    fprintf(stderr, "Built without -DFFFUZZ_FUNC_INDEX, cannot record %s\n", filename);
+    return -1;
+#endif
+}
+
+void func_index_begin_input(void)
+{
+    uint32_t i;
+
+    /* re-arm the guards hit since the previous input began */
+    for (i = 0; i < nb_hits; i++)
+        *guards[hit_ids[i] - 1] = hit_ids[i];
+    nb_hits = 0;
+}
+
+static int module_id(const char *path)
+{
+    char *resolved;
+    int i;
+
+    for (i = 0; i < nb_modules; i++)
+        if (modules[i] == path || !strcmp(modules[i], path))
+            return i;
+    if (nb_modules == MAX_MODULES)
+        return -1;
+    modules[nb_modules] = path;
+    /* the main program is named as it was run */
+    resolved = realpath(path, NULL);
+    fprintf(index_log, "module %d %s\n", nb_modules, resolved ? resolved : path);
+    free(resolved);
+    return nb_modules++;
+}
+
+void func_index_end_input(const char *src_filename)
+{
+    uint32_t i, n = __atomic_load_n(&nb_hits, __ATOMIC_RELAXED);
+
+    if (!index_log)
+        return;
+    /* module lines have to come before the input line using them */
+    for (i = 0; i < n; i++) {
+        Dl_info info;
+        hit_modules[i] = -1;
+        if (!dladdr((void *)hit_pcs[i], &info) || !info.dli_fname)
+            continue;
+        hit_modules[i] = module_id(info.dli_fname);
+        hit_pcs[i] -= (uintptr_t)info.dli_fbase;
+    }
+    fprintf(index_log, "%s\t", src_filename);
+    for (i = 0; i < n; i++)
+        if (hit_modules[i] >= 0)
+            fprintf(index_log, " %d:%"PRIxPTR, hit_modules[i], hit_pcs[i]);
+    fprintf(index_log, "\n");
+}
+
+void func_index_close(void)
+{
+    if (index_log)
+        fclose(index_log);
+    index_log = NULL;
+}
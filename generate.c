@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Synthetic benchmark corpus from the linked encoders and muxers (-M generate).
+ *
+ * Every target pairs an encoder with a container; each target gets
+ * GENERATE_PER_TARGET inputs whose resolution, pixel format (bit depth), GOP
+ * length, B-frames, slice count and length are drawn from the seed. Frames
+ * are a moving gradient with seeded noise, and encoders and muxers run
+ * single threaded in bitexact mode, so a seed gives the same files on any
+ * box with the same FFmpeg. Targets whose encoder is not built in are
+ * skipped. A manifest lists every file with the -f and -c to decode it with.
+ * An input that fails to encode or mux fails the run, since the corpus of a
+ * seed would otherwise differ between boxes.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/intreadwrite.h>
+#include <libavutil/pixdesc.h>
+#include <libavformat/avformat.h>
+
+#include "fffuzz.h"
+
+#define GENERATE_PER_TARGET 3
+#define MAX_FORMATS 4
+
+struct target {
+    const char *encoder;
+    const char *muxer;
+    const char *extension;
+    const char *demuxer;        ///< as -f takes it
+    int b_frames;               ///< the encoder has B-frames
+    int slices;                 ///< the encoder takes a slice count
+    enum AVPixelFormat formats[MAX_FORMATS];   ///< terminated by AV_PIX_FMT_NONE
+    const char *options;        ///< encoder options, key=value:...
+};
+
+static const struct target targets[] = {
+    { "mpeg2video", "mpegts",   "ts",  "mpegts",   1, 1,
+      { AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P, AV_PIX_FMT_NONE } },
+    { "mpeg1video", "mpeg",     "mpg", "mpeg",     1, 0,
+      { AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE } },
+    { "mpeg4",      "avi",      "avi", "avi",      1, 0,
+      { AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE } },
+    { "mjpeg",      "avi",      "avi", "avi",      0, 0,
+      { AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUVJ422P, AV_PIX_FMT_NONE } },
+    { "ffv1",       "matroska", "mkv", "matroska", 0, 1,
+      { AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV444P16LE, AV_PIX_FMT_NONE },
+      "level=3" },
+    { "prores",     "mov",      "mov", "mov",      0, 0,
+      { AV_PIX_FMT_YUV422P10LE, AV_PIX_FMT_NONE } },
+    { "huffyuv",    "avi",      "avi", "avi",      0, 0,
+      { AV_PIX_FMT_YUV422P, AV_PIX_FMT_NONE } },
+    { "utvideo",    "avi",      "avi", "avi",      0, 0,
+      { AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P, AV_PIX_FMT_NONE } },
+    { "snow",       "nut",      "nut", "nut",      0, 0,
+      { AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE } },
+    { "libx264",    "mp4",      "mp4", "mov",      1, 1,
+      { AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P, AV_PIX_FMT_NONE } },
+    { "libx265",    "matroska", "mkv", "matroska", 1, 0,
+      { AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE } },
+};
+
+static const int resolutions[][2] = {
+    { 176, 144 }, { 352, 288 }, { 640, 360 }, { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 },
+};
+static const int gop_sizes[]    = { 1, 12, 60 };
+static const int slice_counts[] = { 1, 4, 8 };
+static const int frame_counts[] = { 8, 30, 60 };
+
+struct params {
+    int width, height;
+    enum AVPixelFormat pix_fmt;
+    int gop_size;
+    int max_b_frames;
+    int slices;
+    int nb_frames;
+};
+
+/* xorshift64*, the same sequence for the same seed everywhere */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+#define PICK(array, state) array[next_random(state) % FF_ARRAY_ELEMS(array)]
+
+static void fill_frame(AVFrame *frame, int n, uint64_t *state)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    int depth = desc->comp[0].depth;
+    int max = (1 << depth) - 1;
+    int p, x, y;
+
+    for (p = 0; p < 4 && frame->data[p]; p++) {
+        int w = frame->width, h = frame->height;
+        if (p == 1 || p == 2) {
+            w = -((-w) >> desc->log2_chroma_w);
+            h = -((-h) >> desc->log2_chroma_h);
+        }
+        for (y = 0; y < h; y++) {
+            uint8_t *line = frame->data[p] + y * frame->linesize[p];
+            uint64_t noise = next_random(state);
+            for (x = 0; x < w; x++) {
+                /* a gradient moving with n, and a few bits of noise */
+                int v = (((x + 2 * y + 3 * n * (p + 1)) << (depth - 8)) +
+                         (int)(noise >> (x & 63) & 7)) & max;
+                if (depth > 8)
+                    AV_WL16(line + 2 * x, v);
+                else
+                    line[x] = v;
+            }
+        }
+    }
+}
+
+static int write_packets(AVFormatContext *oc, AVStream *st, AVFrame *frame)
+{
+    AVPacket pkt = { 0 };
+    int got_packet, ret;
+
+    /* without a frame, drain all the delayed packets */
+    do {
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        ret = avcodec_encode_video2(st->codec, &pkt, frame, &got_packet);
+        if (ret < 0) {
+            fprintf(stderr, "Error encoding video frame (%s)\n", av_err2str(ret));
+            return ret;
+        }
+        if (!got_packet)
+            return 0;
+        av_packet_rescale_ts(&pkt, st->codec->time_base, st->time_base);
+        pkt.stream_index = st->index;
+        ret = av_interleaved_write_frame(oc, &pkt);
+        if (ret < 0) {
+            fprintf(stderr, "Error muxing packet (%s)\n", av_err2str(ret));
+            return ret;
+        }
+    } while (!frame);
+    return 0;
+}
+
+static int generate_input(const char *filename, const struct target *target,
+                          AVCodec *enc, const struct params *params, uint64_t *state)
+{
+    AVFormatContext *oc = NULL;
+    AVStream *st;
+    AVCodecContext *c;
+    AVDictionary *opts = NULL;
+    AVFrame *frame = NULL;
+    int ret = -1, n, header_written = 0;
+
+    if (avformat_alloc_output_context2(&oc, NULL, target->muxer, filename) < 0) {
+        fprintf(stderr, "Could not find muxer %s\n", target->muxer);
+        return -1;
+    }
+    oc->flags |= AVFMT_FLAG_BITEXACT;
+    st = avformat_new_stream(oc, enc);
+    if (!st)
+        goto end;
+    c = st->codec;
+    c->width         = params->width;
+    c->height        = params->height;
+    c->pix_fmt       = params->pix_fmt;
+    c->gop_size      = params->gop_size;
+    c->max_b_frames  = params->max_b_frames;
+    c->slices        = params->slices;
+    c->bit_rate      = (int64_t)params->width * params->height * 3;
+    c->time_base     = st->time_base = (AVRational){ 1, 25 };
+    c->thread_count  = 1;
+    c->flags        |= AV_CODEC_FLAG_BITEXACT;
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+        c->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    av_dict_set(&opts, "strict", "-2", 0);
+    if (target->options)
+        av_dict_parse_string(&opts, target->options, "=", ":", 0);
+    if (avcodec_open2(c, enc, &opts) < 0) {
+        fprintf(stderr, "Could not open encoder %s\n", target->encoder);
+        goto end;
+    }
+
+    frame = av_frame_alloc();
+    if (!frame)
+        goto end;
+    frame->format = c->pix_fmt;
+    frame->width  = c->width;
+    frame->height = c->height;
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        fprintf(stderr, "Could not allocate frame\n");
+        goto end;
+    }
+
+    if (avio_open(&oc->pb, filename, AVIO_FLAG_WRITE) < 0) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        goto end;
+    }
+    if (avformat_write_header(oc, NULL) < 0) {
+        fprintf(stderr, "Could not write header of %s\n", filename);
+        goto end;
+    }
+    header_written = 1;
+
+    for (n = 0; n < params->nb_frames; n++) {
+        /* the encoder may still hold a reference to the previous frame */
+        if (av_frame_make_writable(frame) < 0)
+            goto end;
+        fill_frame(frame, n, state);
+        frame->pts = n;
+        if (write_packets(oc, st, frame) < 0)
+            goto end;
+    }
+    if (write_packets(oc, st, NULL) < 0)
+        goto end;
+    ret = 0;
+
+end:
+    if (header_written && av_write_trailer(oc) < 0)
+        ret = -1;
+    av_dict_free(&opts);
+    av_frame_free(&frame);
+    if (st)
+        avcodec_close(st->codec);
+    if (oc->pb)
+        avio_closep(&oc->pb);
+    avformat_free_context(oc);
+    return ret;
+}
+
+int generate_corpus(uint64_t seed, const char *dirname)
+{
+    char *manifest_filename = av_asprintf("%s/manifest", dirname);
+    FILE *manifest = NULL;
+    uint64_t state = seed ? seed : 1;
+    int nb_generated = 0, nb_failed = 0, ret = 1;
+    unsigned t, i;
+
+    if (mkdir(dirname, 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create corpus directory %s\n", dirname);
+        goto end;
+    }
+    if (!manifest_filename || !(manifest = fopen(manifest_filename, "w"))) {
+        fprintf(stderr, "Could not open manifest in %s\n", dirname);
+        goto end;
+    }
+
+    for (t = 0; t < FF_ARRAY_ELEMS(targets); t++) {
+        const struct target *target = &targets[t];
+        AVCodec *enc = avcodec_find_encoder_by_name(target->encoder);
+        AVCodec *dec;
+        int nb_formats = 0;
+
+        while (nb_formats < MAX_FORMATS && target->formats[nb_formats] != AV_PIX_FMT_NONE)
+            nb_formats++;
+        /* draw the parameters even for skipped targets, so that the other
+         * targets get the same inputs whichever encoders are built in */
+        for (i = 0; i < GENERATE_PER_TARGET; i++) {
+            struct params params;
+            const int *resolution = PICK(resolutions, &state);
+            uint64_t frame_state = next_random(&state);
+            char *filename;
+
+            params.width        = resolution[0];
+            params.height       = resolution[1];
+            params.pix_fmt      = target->formats[next_random(&state) % nb_formats];
+            params.gop_size     = PICK(gop_sizes, &state);
+            params.max_b_frames = target->b_frames && params.gop_size > 1 ?
+                                  next_random(&state) % 3 : 0;
+            params.slices       = target->slices ? PICK(slice_counts, &state) : 0;
+            params.nb_frames    = PICK(frame_counts, &state);
+            if (!enc)
+                continue;
+
+            filename = av_asprintf("%s/%02u%u-%s-%dx%d-%s-g%d-b%d-s%d.%s", dirname, t, i,
+                                   target->encoder, params.width, params.height,
+                                   av_get_pix_fmt_name(params.pix_fmt), params.gop_size,
+                                   params.max_b_frames, params.slices, target->extension);
+            if (!filename)
+                goto end;
+            if (generate_input(filename, target, enc, &params, &frame_state) < 0) {
+                nb_failed++;
+                remove(filename);
+            } else {
+                dec = avcodec_find_decoder(enc->id);
+                printf("Generated %s (%d frames)\n", filename, params.nb_frames);
+                fprintf(manifest, "%s -f %s -c %s\n", strrchr(filename, '/') + 1,
+                        target->demuxer, dec ? dec->name : target->encoder);
+                nb_generated++;
+            }
+            av_free(filename);
+        }
+        if (!enc)
+            fprintf(stderr, "Encoder %s not built in, skipped\n", target->encoder);
+    }
+
+    printf("Generated %d inputs into '%s' from seed %"PRIu64", %d failed\n",
+           nb_generated, dirname, seed, nb_failed);
+    ret = nb_failed > 0;
+
+end:
+    if (manifest)
+        fclose(manifest);
+    av_free(manifest_filename);
+    return ret;
+}
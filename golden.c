@@ -0,0 +1,674 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Golden output hashes for regression runs.
+ *
+ * Every decoded frame is hashed, and the frame hashes of an input are hashed
+ * again into a file hash. The database maps a hash of the input bytes to the
+ * file hash and frame hashes seen when it was last updated. It is a header,
+ * an array of fixed size entries sorted by input hash and one array of all
+ * frame hashes, so it is used straight from mmap() with a binary search.
+ * All fields are stored in host byte order.
+ *
+ * With golden_start_threads() video and audio frames are hashed on helper
+ * threads. Frame n goes to helper n % nb_helpers through its own single
+ * producer, single consumer ring of new frame references, and every helper
+ * keeps its hashes in order, so they are interleaved back into frame order
+ * when the input ends.
+ */
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/murmur3.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/samplefmt.h>
+#include <libavcodec/avcodec.h>
+
+#include "fffuzz.h"
+
+#define GOLDEN_MAGIC   "FFGOLDEN"
+#define GOLDEN_VERSION 1
+
+#define HASH_QUEUE_DEPTH 8
+
+struct golden_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    uint64_t nb_entries;
+    uint64_t nb_frame_hashes;
+};
+
+struct golden_entry {
+    uint8_t  key[16];           ///< murmur3 of the input bytes
+    uint8_t  file_hash[16];     ///< murmur3 of the frame hashes
+    uint64_t first_frame;       ///< index of the first frame hash
+    uint32_t nb_frames;
+    uint32_t sequence;          ///< order of pending updates, 0 on disk
+};
+
+static const char *db_filename;
+static int update;
+static int nb_mismatches;
+
+/* database mapped for comparing */
+static uint8_t *map;
+static size_t map_size;
+
+/* the input being decoded */
+static struct golden_entry current;
+static uint64_t *frame_hashes;
+static int nb_frame_hashes, max_frame_hashes;
+
+/* results waiting to be merged into the database */
+static struct golden_entry *updates;
+static uint64_t *update_frames;
+static int nb_updates, max_updates;
+static uint64_t nb_update_frames, max_update_frames;
+
+enum hash_job_type {
+    HASH_JOB_FRAME,
+    HASH_JOB_DRAIN,     ///< report back once every earlier frame is hashed
+    HASH_JOB_STOP,
+};
+
+struct hash_job {
+    enum hash_job_type job;
+    enum AVMediaType type;
+    AVFrame *frame;
+};
+
+struct hash_helper {
+    pthread_t thread;
+    /* the semaphores order the ring, head and tail have one owner each */
+    struct hash_job ring[HASH_QUEUE_DEPTH];
+    unsigned head, tail;
+    sem_t filled, space, drained;
+    /* hashes of this helper's frames, read by the producer after a drain */
+    uint64_t *hashes;
+    int nb_hashes, max_hashes;
+    int error;          ///< a hash could not be stored, hashes are incomplete
+};
+
+static struct hash_helper *helpers;
+static int nb_helpers;
+static uint64_t nb_pending;     ///< frames handed to the helpers since the last drain
+
+static int map_database(const char *filename, uint8_t **data, size_t *size)
+{
+    const struct golden_header *header;
+    struct stat st;
+    int fd = open(filename, O_RDONLY);
+
+    *data = NULL;
+    *size = 0;
+    if (fd < 0)
+        return 0;   /* no database yet */
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*header)) {
+        close(fd);
+        fprintf(stderr, "Golden database %s is truncated\n", filename);
+        return -1;
+    }
+    *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (*data == MAP_FAILED) {
+        *data = NULL;
+        fprintf(stderr, "Could not map golden database %s\n", filename);
+        return -1;
+    }
+    *size = st.st_size;
+
+    header = (const struct golden_header *)*data;
+    if (memcmp(header->magic, GOLDEN_MAGIC, 8) || header->version != GOLDEN_VERSION ||
+        header->entry_size != sizeof(struct golden_entry) ||
+        sizeof(*header) + header->nb_entries * sizeof(struct golden_entry) +
+        header->nb_frame_hashes * sizeof(uint64_t) > *size) {
+        fprintf(stderr, "%s is not a golden database\n", filename);
+        munmap(*data, *size);
+        *data = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static const struct golden_entry *db_entries(const uint8_t *data)
+{
+    return (const struct golden_entry *)(data + sizeof(struct golden_header));
+}
+
+static const uint64_t *db_frame_hashes(const uint8_t *data)
+{
+    const struct golden_header *header = (const struct golden_header *)data;
+    return (const uint64_t *)(db_entries(data) + header->nb_entries);
+}
+
+/* whether the frame hashes of entry lie within the database */
+static int db_entry_valid(const uint8_t *data, const struct golden_entry *entry)
+{
+    const struct golden_header *header = (const struct golden_header *)data;
+    return entry->first_frame <= header->nb_frame_hashes &&
+           entry->nb_frames <= header->nb_frame_hashes - entry->first_frame;
+}
+
+static int cmp_key(const void *key, const void *entry)
+{
+    return memcmp(key, ((const struct golden_entry *)entry)->key, 16);
+}
+
+int golden_open(const char *filename, int update_database)
+{
+    db_filename = filename;
+    update      = update_database;
+    if (update)
+        return 0;
+    return map_database(filename, &map, &map_size);
+}
+
+int golden_begin_input(const char *src_filename, const uint8_t *data, size_t size)
+{
+    struct AVMurMur3 *ctx = av_murmur3_alloc();
+    uint8_t buf[65536];
+    FILE *f;
+    size_t n;
+
+    memset(&current, 0, sizeof(current));
+    nb_frame_hashes = 0;
+    if (!ctx)
+        return -1;
+    av_murmur3_init(ctx);
+    if (data) {
+        for (; size > 0; data += n, size -= n) {
+            n = FFMIN(size, INT_MAX);
+            av_murmur3_update(ctx, data, n);
+        }
+    } else {
+        f = fopen(src_filename, "rb");
+        if (!f) {
+            av_free(ctx);
+            return -1;
+        }
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+            av_murmur3_update(ctx, buf, n);
+        fclose(f);
+    }
+    av_murmur3_final(ctx, current.key);
+    av_free(ctx);
+    return 0;
+}
+
+static uint64_t final_hash64(struct AVMurMur3 *ctx)
+{
+    uint8_t hash[16];
+    uint64_t h;
+
+    av_murmur3_final(ctx, hash);
+    memcpy(&h, hash, sizeof(h));
+    return h;
+}
+
+uint64_t golden_hash_frame(const AVFrame *frame, enum AVMediaType type)
+{
+    struct AVMurMur3 *ctx = av_murmur3_alloc();
+    uint64_t hash = 0;
+    int p, y;
+
+    if (!ctx)
+        return 0;
+    av_murmur3_init(ctx);
+
+    if (type == AVMEDIA_TYPE_VIDEO) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+        int linesizes[4];
+
+        if (desc && av_image_fill_linesizes(linesizes, frame->format, frame->width) >= 0) {
+            for (p = 0; p < 4 && frame->data[p]; p++) {
+                int h = frame->height;
+                if (p == 1 && (desc->flags & AV_PIX_FMT_FLAG_PAL)) {
+                    av_murmur3_update(ctx, frame->data[1], 256 * 4);
+                    break;
+                }
+                if (p == 1 || p == 2)
+                    h = (h + (1 << desc->log2_chroma_h) - 1) >> desc->log2_chroma_h;
+                for (y = 0; y < h; y++)
+                    av_murmur3_update(ctx, frame->data[p] + y * frame->linesize[p], linesizes[p]);
+            }
+        }
+    } else if (type == AVMEDIA_TYPE_AUDIO) {
+        int channels = av_frame_get_channels(frame);
+        int size     = frame->nb_samples * av_get_bytes_per_sample(frame->format);
+        int planes   = av_sample_fmt_is_planar(frame->format) ? channels : 1;
+
+        if (!av_sample_fmt_is_planar(frame->format))
+            size *= channels;
+        for (p = 0; p < planes; p++)
+            av_murmur3_update(ctx, frame->extended_data[p], size);
+    }
+
+    hash = final_hash64(ctx);
+    av_free(ctx);
+    return hash;
+}
+
+uint64_t golden_hash_subtitle(const AVSubtitle *sub)
+{
+    struct AVMurMur3 *ctx = av_murmur3_alloc();
+    uint64_t hash = 0;
+    unsigned i, y;
+
+    if (!ctx)
+        return 0;
+    av_murmur3_init(ctx);
+    for (i = 0; i < sub->num_rects; i++) {
+        const AVSubtitleRect *rect = sub->rects[i];
+        if (rect->text)
+            av_murmur3_update(ctx, (const uint8_t *)rect->text, strlen(rect->text));
+        if (rect->ass)
+            av_murmur3_update(ctx, (const uint8_t *)rect->ass, strlen(rect->ass));
+        if (rect->pict.data[0] && rect->w > 0)
+            for (y = 0; y < (unsigned)rect->h; y++)
+                av_murmur3_update(ctx, rect->pict.data[0] + y * rect->pict.linesize[0], rect->w);
+        if (rect->pict.data[1])
+            av_murmur3_update(ctx, rect->pict.data[1], 4 * rect->nb_colors);
+    }
+    hash = final_hash64(ctx);
+    av_free(ctx);
+    return hash;
+}
+
+uint64_t golden_hash_data(const uint8_t *data, size_t size)
+{
+    struct AVMurMur3 *ctx = av_murmur3_alloc();
+    uint64_t hash = 0;
+
+    if (!ctx)
+        return 0;
+    av_murmur3_init(ctx);
+    av_murmur3_update(ctx, data, size);
+    hash = final_hash64(ctx);
+    av_free(ctx);
+    return hash;
+}
+
+int golden_add_frame(uint64_t hash)
+{
+    if (nb_frame_hashes == max_frame_hashes) {
+        uint64_t *tmp;
+        max_frame_hashes = FFMAX(2 * max_frame_hashes, 256);
+        tmp = av_realloc(frame_hashes, max_frame_hashes * sizeof(*frame_hashes));
+        if (!tmp)
+            return -1;
+        frame_hashes = tmp;
+    }
+    frame_hashes[nb_frame_hashes++] = hash;
+    return 0;
+}
+
+static void *hash_thread(void *arg)
+{
+    struct hash_helper *h = arg;
+
+    for (;;) {
+        struct hash_job job;
+
+        sem_wait(&h->filled);
+        job = h->ring[h->head++ % HASH_QUEUE_DEPTH];
+        sem_post(&h->space);
+
+        if (job.job == HASH_JOB_STOP)
+            break;
+        if (job.job == HASH_JOB_DRAIN) {
+            sem_post(&h->drained);
+            continue;
+        }
+        if (!h->error && h->nb_hashes == h->max_hashes) {
+            int max_hashes = FFMAX(2 * h->max_hashes, 256);
+            uint64_t *tmp = av_realloc(h->hashes, max_hashes * sizeof(*h->hashes));
+            if (tmp) {
+                h->hashes     = tmp;
+                h->max_hashes = max_hashes;
+            } else {
+                /* reported by the next drain, the frames are only freed */
+                h->error = 1;
+            }
+        }
+        if (!h->error)
+            h->hashes[h->nb_hashes++] = golden_hash_frame(job.frame, job.type);
+        av_frame_free(&job.frame);
+    }
+    return NULL;
+}
+
+static void push_job(struct hash_helper *h, enum hash_job_type job, AVFrame *frame,
+                     enum AVMediaType type)
+{
+    sem_wait(&h->space);
+    h->ring[h->tail % HASH_QUEUE_DEPTH].job   = job;
+    h->ring[h->tail % HASH_QUEUE_DEPTH].frame = frame;
+    h->ring[h->tail % HASH_QUEUE_DEPTH].type  = type;
+    h->tail++;
+    sem_post(&h->filled);
+}
+
+/**
+ * Wait for the helpers and append their hashes in frame order.
+ *
+ * @return 0, or <0 if a helper or golden_add_frame() could not store a hash
+ */
+static int drain_helpers(void)
+{
+    uint64_t n;
+    int i, ret = 0;
+
+    if (!nb_pending)
+        return 0;
+    for (i = 0; i < nb_helpers; i++)
+        push_job(&helpers[i], HASH_JOB_DRAIN, NULL, AVMEDIA_TYPE_UNKNOWN);
+    for (i = 0; i < nb_helpers; i++) {
+        sem_wait(&helpers[i].drained);
+        if (helpers[i].error)
+            ret = -1;
+    }
+    for (n = 0; !ret && n < nb_pending; n++)
+        ret = golden_add_frame(helpers[n % nb_helpers].hashes[n / nb_helpers]);
+    for (i = 0; i < nb_helpers; i++) {
+        helpers[i].nb_hashes = 0;
+        helpers[i].error     = 0;
+    }
+    nb_pending = 0;
+    return ret;
+}
+
+int golden_start_threads(int nb_threads)
+{
+    int i;
+
+    helpers = av_mallocz_array(nb_threads, sizeof(*helpers));
+    if (!helpers)
+        return -1;
+    for (i = 0; i < nb_threads; i++) {
+        struct hash_helper *h = &helpers[i];
+        sem_init(&h->filled, 0, 0);
+        sem_init(&h->space, 0, HASH_QUEUE_DEPTH);
+        sem_init(&h->drained, 0, 0);
+        if (pthread_create(&h->thread, NULL, hash_thread, h)) {
+            fprintf(stderr, "Could not start hash thread %d\n", i);
+            return -1;
+        }
+        nb_helpers++;
+    }
+    return 0;
+}
+
+int golden_queue_frame(const AVFrame *frame, enum AVMediaType type)
+{
+    AVFrame *ref = nb_helpers ? av_frame_clone(frame) : NULL;
+
+    if (!ref) {
+        /* hashed here, after everything queued before it */
+        if (drain_helpers() < 0)
+            return -1;
+        return golden_add_frame(golden_hash_frame(frame, type));
+    }
+    push_job(&helpers[nb_pending++ % nb_helpers], HASH_JOB_FRAME, ref, type);
+    return 0;
+}
+
+static int add_update(void)
+{
+    if (nb_updates == max_updates) {
+        struct golden_entry *tmp;
+        max_updates = FFMAX(2 * max_updates, 64);
+        tmp = av_realloc(updates, max_updates * sizeof(*updates));
+        if (!tmp)
+            return -1;
+        updates = tmp;
+    }
+    if (nb_update_frames + nb_frame_hashes > max_update_frames) {
+        uint64_t *tmp;
+        max_update_frames = FFMAX(2 * max_update_frames, nb_update_frames + nb_frame_hashes);
+        tmp = av_realloc(update_frames, max_update_frames * sizeof(*update_frames));
+        if (!tmp)
+            return -1;
+        update_frames = tmp;
+    }
+    memcpy(update_frames + nb_update_frames, frame_hashes, nb_frame_hashes * sizeof(*frame_hashes));
+    current.first_frame = nb_update_frames;
+    current.sequence    = nb_updates;
+    nb_update_frames += nb_frame_hashes;
+    updates[nb_updates++] = current;
+    return 0;
+}
+
+int golden_end_input(const char *src_filename)
+{
+    const struct golden_entry *golden = NULL;
+    struct AVMurMur3 *ctx = av_murmur3_alloc();
+    int i;
+
+    if (drain_helpers() < 0) {
+        fprintf(stderr, "Could not store the frame hashes of %s\n", src_filename);
+        av_free(ctx);
+        return -1;
+    }
+    if (!ctx)
+        return -1;
+    av_murmur3_init(ctx);
+    av_murmur3_update(ctx, (const uint8_t *)frame_hashes, nb_frame_hashes * sizeof(*frame_hashes));
+    av_murmur3_final(ctx, current.file_hash);
+    av_free(ctx);
+    current.nb_frames = nb_frame_hashes;
+
+    if (update)
+        return add_update();
+
+    if (map) {
+        const struct golden_header *header = (const struct golden_header *)map;
+        golden = bsearch(current.key, db_entries(map), header->nb_entries,
+                         sizeof(*golden), cmp_key);
+    }
+    if (!golden) {
+        printf("golden %s: new\n", src_filename);
+        nb_mismatches++;
+        return 1;
+    }
+    if (!db_entry_valid(map, golden)) {
+        fprintf(stderr, "Golden database %s: frames of %s out of range\n",
+                db_filename, src_filename);
+        return -1;
+    }
+    if (!memcmp(golden->file_hash, current.file_hash, 16)) {
+        printf("golden %s: match frames:%d\n", src_filename, nb_frame_hashes);
+        return 0;
+    }
+
+    for (i = 0; i < nb_frame_hashes && i < (int)golden->nb_frames; i++)
+        if (db_frame_hashes(map)[golden->first_frame + i] != frame_hashes[i])
+            break;
+    printf("golden %s: mismatch frame:%d frames:%d golden_frames:%u\n",
+           src_filename, i, nb_frame_hashes, golden->nb_frames);
+    nb_mismatches++;
+    return 1;
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+    const struct golden_entry *x = a, *y = b;
+    int cmp = memcmp(x->key, y->key, 16);
+    /* keep the latest result for the same input last */
+    return cmp ? cmp : (x->sequence > y->sequence) - (x->sequence < y->sequence);
+}
+
+static int write_entry(FILE *f, FILE *frames, const struct golden_entry *entry,
+                       const uint64_t *hashes, uint64_t *nb_written)
+{
+    struct golden_entry out = *entry;
+
+    out.first_frame = *nb_written;
+    out.sequence    = 0;
+    *nb_written += entry->nb_frames;
+    if (fwrite(&out, sizeof(out), 1, f) != 1 ||
+        fwrite(hashes + entry->first_frame, sizeof(*hashes), entry->nb_frames, frames) != entry->nb_frames)
+        return -1;
+    return 0;
+}
+
+/* merge the new results into the database, replacing entries for the same input */
+static int write_database(void)
+{
+    struct golden_header header = {
+        .magic = GOLDEN_MAGIC, .version = GOLDEN_VERSION, .entry_size = sizeof(struct golden_entry),
+    };
+    const struct golden_entry *old = NULL;
+    const uint64_t *old_frames = NULL;
+    uint8_t *old_map;
+    size_t old_size;
+    uint64_t nb_old = 0, o = 0, nb_written = 0;
+    char *tmp_filename = av_asprintf("%s.tmp", db_filename);
+    char *lock_filename = av_asprintf("%s.lock", db_filename);
+    FILE *f = NULL, *frames = NULL;
+    char buf[65536];
+    size_t n;
+    int lock_fd = -1, i, u, ret = -1;
+
+    if (!tmp_filename || !lock_filename)
+        goto end;
+    lock_fd = open(lock_filename, O_RDWR | O_CREAT, 0644);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX) < 0) {
+        fprintf(stderr, "Could not lock %s\n", lock_filename);
+        goto end;
+    }
+    if (map_database(db_filename, &old_map, &old_size) < 0)
+        goto end;
+    if (old_map) {
+        nb_old     = ((const struct golden_header *)old_map)->nb_entries;
+        old        = db_entries(old_map);
+        old_frames = db_frame_hashes(old_map);
+    }
+
+    /* sort the new results, keeping only the last one for each input */
+    qsort(updates, nb_updates, sizeof(*updates), cmp_entry);
+    for (i = 0, u = 0; i < nb_updates; i++) {
+        if (i + 1 < nb_updates && !memcmp(updates[i].key, updates[i + 1].key, 16))
+            continue;
+        updates[u++] = updates[i];
+    }
+
+    f      = fopen(tmp_filename, "wb");
+    frames = tmpfile();
+    if (!f || !frames) {
+        fprintf(stderr, "Could not open %s\n", tmp_filename);
+        goto end;
+    }
+    if (fseek(f, sizeof(header), SEEK_SET) < 0)
+        goto end;
+    for (i = 0; i < u || o < nb_old;) {
+        int cmp = i == u ? 1 : o == nb_old ? -1 : memcmp(updates[i].key, old[o].key, 16);
+        if (cmp <= 0) {
+            if (write_entry(f, frames, &updates[i++], update_frames, &nb_written) < 0)
+                goto end;
+            o += !cmp;
+        } else if (!db_entry_valid(old_map, &old[o])) {
+            fprintf(stderr, "Golden database %s: frames of entry %"PRIu64" out of range\n",
+                    db_filename, o);
+            goto end;
+        } else if (write_entry(f, frames, &old[o++], old_frames, &nb_written) < 0) {
+            goto end;
+        }
+        header.nb_entries++;
+    }
+    header.nb_frame_hashes = nb_written;
+
+    /* frame hashes follow the entries */
+    rewind(frames);
+    while ((n = fread(buf, 1, sizeof(buf), frames)) > 0)
+        if (fwrite(buf, 1, n, f) != n)
+            goto end;
+    rewind(f);
+    if (fwrite(&header, sizeof(header), 1, f) != 1)
+        goto end;
+    if (fclose(f)) {
+        f = NULL;
+        goto end;
+    }
+    f = NULL;
+    if (rename(tmp_filename, db_filename) < 0) {
+        fprintf(stderr, "Could not replace %s\n", db_filename);
+        goto end;
+    }
+    printf("golden: %d inputs updated, %"PRIu64" in %s\n", u, header.nb_entries, db_filename);
+    ret = 0;
+
+end:
+    if (f) {
+        fclose(f);
+        unlink(tmp_filename);
+    }
+    if (frames)
+        fclose(frames);
+    if (old_map)
+        munmap(old_map, old_size);
+    if (lock_fd >= 0)
+        close(lock_fd);
+    av_free(tmp_filename);
+    av_free(lock_filename);
+    return ret;
+}
+
+int golden_close(void)
+{
+    int ret = 0, i;
+
+    for (i = 0; i < nb_helpers; i++)
+        push_job(&helpers[i], HASH_JOB_STOP, NULL, AVMEDIA_TYPE_UNKNOWN);
+    for (i = 0; i < nb_helpers; i++) {
+        pthread_join(helpers[i].thread, NULL);
+        sem_destroy(&helpers[i].filled);
+        sem_destroy(&helpers[i].space);
+        sem_destroy(&helpers[i].drained);
+        av_freep(&helpers[i].hashes);
+    }
+    av_freep(&helpers);
+    nb_helpers = 0;
+
+    if (update && nb_updates && write_database() < 0)
+        ret = -1;
+    if (map)
+        munmap(map, map_size);
+    map = NULL;
+    av_freep(&frame_hashes);
+    av_freep(&updates);
+    av_freep(&update_frames);
+    return ret < 0 ? ret : nb_mismatches > 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Video frame buffers and the rawvideo staging buffer on 2 MB pages (-l huge).
+ *
+ * Blocks are mapped with MAP_HUGETLB while the hugetlbfs pool has pages,
+ * else 2 MB aligned and madvise(MADV_HUGEPAGE)d for transparent hugepages,
+ * else they stay on small pages. Released frame buffers go back to a free
+ * list instead of being unmapped, so later frames and later persistent mode
+ * iterations reuse blocks whose pages are already faulted in. The block
+ * kinds are counted for the -B report, next to the dTLB misses per stage.
+ */
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+#include "fffuzz.h"
+
+#define HUGE_PAGE_SIZE (2 << 20)
+#define HUGE_MAX_FREE  32       ///< free blocks kept, larger ones are unmapped first
+/* libavcodec's own pools pad every plane buffer by 16 + STRIDE_ALIGN - 1 */
+#define HUGE_FRAME_PADDING (16 + 64 - 1)
+
+enum block_kind {
+    BLOCK_HUGETLB,
+    BLOCK_THP,
+    BLOCK_SMALL,
+    BLOCK_KIND_NB
+};
+
+struct huge_block {
+    uint8_t *data;
+    size_t size;
+    enum block_kind kind;
+    struct huge_block *next;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct huge_block *free_blocks;
+static int nb_free;
+static int hugetlb_available;
+
+static struct huge_block *staging;
+
+static int nb_mapped[BLOCK_KIND_NB];
+static uint64_t nb_reused;
+static size_t mapped_bytes;
+
+static struct huge_block *map_block(size_t size)
+{
+    struct huge_block *block = calloc(1, sizeof(*block));
+    uint8_t *p;
+    size_t head;
+
+    if (!block)
+        return NULL;
+    block->size = FFALIGN(size, HUGE_PAGE_SIZE);
+
+    if (hugetlb_available) {
+        p = mmap(NULL, block->size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            block->data = p;
+            block->kind = BLOCK_HUGETLB;
+            return block;
+        }
+    }
+
+    /* over-map by a page and trim, THP only backs 2 MB aligned ranges */
+    p = mmap(NULL, block->size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        free(block);
+        return NULL;
+    }
+    head = FFALIGN((uintptr_t)p, HUGE_PAGE_SIZE) - (uintptr_t)p;
+    if (head)
+        munmap(p, head);
+    munmap(p + head + block->size, HUGE_PAGE_SIZE - head);
+    block->data = p + head;
+    block->kind = madvise(block->data, block->size, MADV_HUGEPAGE) ? BLOCK_SMALL : BLOCK_THP;
+    return block;
+}
+
+static void unmap_block(struct huge_block *block)
+{
+    munmap(block->data, block->size);
+    free(block);
+}
+
+/* the smallest free block which fits, else a new one */
+static struct huge_block *get_block(size_t size)
+{
+    struct huge_block **p, **best = NULL, *block;
+
+    pthread_mutex_lock(&pool_lock);
+    for (p = &free_blocks; *p; p = &(*p)->next)
+        if ((*p)->size >= size && (!best || (*p)->size < (*best)->size))
+            best = p;
+    if (best) {
+        block = *best;
+        *best = block->next;
+        nb_free--;
+        nb_reused++;
+        pthread_mutex_unlock(&pool_lock);
+        return block;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    block = map_block(size);
+    if (!block)
+        return NULL;
+    pthread_mutex_lock(&pool_lock);
+    nb_mapped[block->kind]++;
+    mapped_bytes += block->size;
+    pthread_mutex_unlock(&pool_lock);
+    return block;
+}
+
+static void put_block(struct huge_block *block)
+{
+    struct huge_block **p, **largest;
+
+    pthread_mutex_lock(&pool_lock);
+    block->next = free_blocks;
+    free_blocks = block;
+    if (++nb_free > HUGE_MAX_FREE) {
+        /* frame sizes changed, give back the block least likely to fit */
+        largest = &free_blocks;
+        for (p = &free_blocks; *p; p = &(*p)->next)
+            if ((*p)->size > (*largest)->size)
+                largest = p;
+        block = *largest;
+        *largest = block->next;
+        nb_free--;
+        mapped_bytes -= block->size;
+        pthread_mutex_unlock(&pool_lock);
+        unmap_block(block);
+        return;
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static void release_buffer(void *opaque, uint8_t *data)
+{
+    put_block(opaque);
+}
+
+int huge_init(void)
+{
+    struct huge_block *probe;
+
+    hugetlb_available = 1;
+    probe = map_block(HUGE_PAGE_SIZE);
+    if (!probe) {
+        fprintf(stderr, "Could not map frame buffers\n");
+        return -1;
+    }
+    if (probe->kind == BLOCK_HUGETLB) {
+        fprintf(stderr, "Using hugetlbfs pages for frame buffers\n");
+    } else {
+        /* do not retry the hugetlbfs pool for every block */
+        hugetlb_available = 0;
+        fprintf(stderr, "No hugetlbfs pages reserved, using %s for frame buffers\n",
+                probe->kind == BLOCK_THP ? "transparent hugepages" : "small pages");
+    }
+    nb_mapped[probe->kind]++;
+    mapped_bytes += probe->size;
+    put_block(probe);
+    return 0;
+}
+
+int huge_get_buffer2(AVCodecContext *avctx, AVFrame *frame, int flags)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    int w = frame->width, h = frame->height;
+    int i, size, unaligned;
+    struct huge_block *block;
+
+    if (avctx->codec_type != AVMEDIA_TYPE_VIDEO || !desc ||
+        desc->flags & AV_PIX_FMT_FLAG_HWACCEL)
+        return avcodec_default_get_buffer2(avctx, frame, flags);
+
+    /* the same layout as avcodec_default_get_buffer2(), in a single block */
+    avcodec_align_dimensions2(avctx, &w, &h, linesize_align);
+    do {
+        if ((size = av_image_fill_linesizes(frame->linesize, frame->format, w)) < 0)
+            return size;
+        w += w & ~(w - 1);
+        unaligned = 0;
+        for (i = 0; i < 4; i++)
+            unaligned |= frame->linesize[i] % linesize_align[i];
+    } while (unaligned);
+    size = av_image_fill_pointers(frame->data, frame->format, h, NULL, frame->linesize);
+    if (size < 0)
+        return size;
+
+    block = get_block(size + HUGE_FRAME_PADDING);
+    if (!block)
+        return AVERROR(ENOMEM);
+    frame->buf[0] = av_buffer_create(block->data, block->size, release_buffer, block, 0);
+    if (!frame->buf[0]) {
+        put_block(block);
+        return AVERROR(ENOMEM);
+    }
+    av_image_fill_pointers(frame->data, frame->format, h, block->data, frame->linesize);
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+int huge_image_alloc(uint8_t *data[4], int linesize[4], int width, int height,
+                     enum AVPixelFormat pix_fmt)
+{
+    int size = av_image_get_buffer_size(pix_fmt, width, height, 1);
+
+    if (size < 0)
+        return size;
+    if (staging && staging->size < (size_t)size) {
+        put_block(staging);
+        staging = NULL;
+    }
+    if (!staging)
+        staging = get_block(size);
+    if (!staging)
+        return AVERROR(ENOMEM);
+    return av_image_fill_arrays(data, linesize, staging->data, pix_fmt, width, height, 1);
+}
+
+void huge_report(FILE *report)
+{
+    pthread_mutex_lock(&pool_lock);
+    fprintf(report, "hugepages hugetlb_blocks:%d thp_blocks:%d small_blocks:%d"
+            " reused:%"PRIu64" mapped_bytes:%zu\n",
+            nb_mapped[BLOCK_HUGETLB], nb_mapped[BLOCK_THP], nb_mapped[BLOCK_SMALL],
+            nb_reused, mapped_bytes);
+    pthread_mutex_unlock(&pool_lock);
+}
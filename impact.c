@@ -0,0 +1,568 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Change-impact test selection from the logs written by fffuzz -i.
+ *
+ * "build" symbolises the function offsets of the logs once per module with
+ * addr2line and writes an inverted index from function (and its source file)
+ * to the inputs which reach it. "select" reads changed function names or
+ * source files and prints only the inputs which reach one of them.
+ *
+ * Index layout: header, input name offsets, function records sorted by name,
+ * delta+varint coded input lists, then a string table. It is used straight
+ * from mmap().
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IMPACT_MAGIC   "FFIMPACT"
+#define IMPACT_VERSION 1
+#define MAX_MODULES    1024
+
+#define GROW(array, count, max) do {                                    \
+    if ((count) == (max)) {                                             \
+        (max) = (max) ? 2 * (max) : 1024;                               \
+        (array) = realloc((array), (max) * sizeof(*(array)));           \
+        if (!(array))                                                   \
+            out_of_memory();                                            \
+    }                                                                   \
+} while (0)
+
+struct index_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t nb_inputs;
+    uint32_t nb_functions;
+    uint32_t postings_size;
+    uint32_t strings_size;
+    uint32_t reserved;
+};
+
+struct index_function {
+    uint32_t name;          ///< string offset
+    uint32_t file;          ///< string offset
+    uint32_t postings;      ///< offset into the input lists
+    uint32_t nb_inputs;
+};
+
+struct address {
+    int module;
+    uint64_t offset;
+    uint32_t function;
+};
+
+struct function {
+    char *name;
+    char *file;
+    uint32_t *inputs;
+    size_t nb_inputs, max_inputs;
+};
+
+static char *module_paths[MAX_MODULES];
+static int nb_module_paths;
+
+static struct address *addresses;
+static size_t nb_addresses, max_addresses;
+static uint32_t *address_table;     ///< address index + 1, 0 for an empty slot
+static size_t address_table_size;
+
+static char **inputs;
+static size_t nb_inputs, max_inputs;
+
+/* (input, address) pairs in log order */
+static uint32_t (*hits)[2];
+static size_t nb_hits, max_hits;
+
+static struct function *functions;
+static size_t nb_functions, max_functions;
+static uint32_t *function_table;    ///< function index + 1, 0 for an empty slot
+static size_t function_table_size;
+
+static void out_of_memory(void)
+{
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+}
+
+static uint64_t hash_string(const char *s, uint64_t h)
+{
+    while (*s)
+        h = (h ^ (uint8_t)*s++) * 0x100000001b3ULL;
+    return h;
+}
+
+static uint64_t address_hash(int module, uint64_t offset)
+{
+    return ((uint64_t)module << 48 ^ offset) * 0x9E3779B97F4A7C15ULL;
+}
+
+static uint64_t function_hash(const char *name, const char *file)
+{
+    return hash_string(file, hash_string(name, 0xcbf29ce484222325ULL) * 31);
+}
+
+/* open addressing tables of indexes + 1, rehashed at half load */
+static void rehash(uint32_t **table, size_t *size, size_t count, uint64_t (*hash)(size_t))
+{
+    size_t i, slot;
+
+    if (2 * (count + 1) <= *size)
+        return;
+    free(*table);
+    *size = *size ? 2 * *size : 65536;
+    *table = calloc(*size, sizeof(**table));
+    if (!*table)
+        out_of_memory();
+    for (i = 0; i < count; i++) {
+        slot = hash(i) & (*size - 1);
+        while ((*table)[slot])
+            slot = (slot + 1) & (*size - 1);
+        (*table)[slot] = i + 1;
+    }
+}
+
+static uint64_t hash_address_at(size_t i)
+{
+    return address_hash(addresses[i].module, addresses[i].offset);
+}
+
+static uint64_t hash_function_at(size_t i)
+{
+    return function_hash(functions[i].name, functions[i].file);
+}
+
+static uint32_t find_address(int module, uint64_t offset)
+{
+    size_t slot;
+
+    rehash(&address_table, &address_table_size, nb_addresses, hash_address_at);
+    slot = address_hash(module, offset) & (address_table_size - 1);
+    for (; address_table[slot]; slot = (slot + 1) & (address_table_size - 1)) {
+        const struct address *a = &addresses[address_table[slot] - 1];
+        if (a->module == module && a->offset == offset)
+            return address_table[slot] - 1;
+    }
+    GROW(addresses, nb_addresses, max_addresses);
+    addresses[nb_addresses].module   = module;
+    addresses[nb_addresses].offset   = offset;
+    addresses[nb_addresses].function = UINT32_MAX;
+    address_table[slot] = ++nb_addresses;
+    return nb_addresses - 1;
+}
+
+static uint32_t find_function(const char *name, const char *file)
+{
+    size_t slot;
+
+    rehash(&function_table, &function_table_size, nb_functions, hash_function_at);
+    slot = function_hash(name, file) & (function_table_size - 1);
+    for (; function_table[slot]; slot = (slot + 1) & (function_table_size - 1)) {
+        const struct function *f = &functions[function_table[slot] - 1];
+        if (!strcmp(f->name, name) && !strcmp(f->file, file))
+            return function_table[slot] - 1;
+    }
+    GROW(functions, nb_functions, max_functions);
+    memset(&functions[nb_functions], 0, sizeof(*functions));
+    functions[nb_functions].name = strdup(name);
+    functions[nb_functions].file = strdup(file);
+    if (!functions[nb_functions].name || !functions[nb_functions].file)
+        out_of_memory();
+    function_table[slot] = ++nb_functions;
+    return nb_functions - 1;
+}
+
+static int module_index(const char *path)
+{
+    int i;
+
+    for (i = 0; i < nb_module_paths; i++)
+        if (!strcmp(module_paths[i], path))
+            return i;
+    if (nb_module_paths == MAX_MODULES)
+        return -1;
+    module_paths[nb_module_paths] = strdup(path);
+    return nb_module_paths++;
+}
+
+static int read_log(const char *filename)
+{
+    int log_modules[MAX_MODULES];
+    FILE *f = fopen(filename, "r");
+    char *line = NULL, *p, *tab;
+    size_t line_size = 0;
+    int i;
+
+    if (!f) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return -1;
+    }
+    /* module ids are only valid within the process which wrote them */
+    for (i = 0; i < MAX_MODULES; i++)
+        log_modules[i] = -1;
+
+    while (getline(&line, &line_size, f) > 0) {
+        int id, len;
+        line[strcspn(line, "\n")] = 0;
+        tab = strchr(line, '\t');
+        if (!tab) {
+            if (sscanf(line, "module %d %n", &id, &len) == 1 && id >= 0 && id < MAX_MODULES)
+                log_modules[id] = module_index(line + len);
+            continue;
+        }
+        *tab = 0;
+        GROW(inputs, nb_inputs, max_inputs);
+        inputs[nb_inputs] = strdup(line);
+
+        for (p = strtok(tab + 1, " "); p; p = strtok(NULL, " ")) {
+            uint64_t offset;
+            if (sscanf(p, "%d:%"SCNx64, &id, &offset) != 2 ||
+                id < 0 || id >= MAX_MODULES || log_modules[id] < 0)
+                continue;
+            GROW(hits, nb_hits, max_hits);
+            hits[nb_hits][0] = nb_inputs;
+            hits[nb_hits][1] = find_address(log_modules[id], offset);
+            nb_hits++;
+        }
+        nb_inputs++;
+    }
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+/* map every address of one module to a function with a single addr2line run */
+static int symbolise_module(int module)
+{
+    char tmp_filename[] = "/tmp/fffuzz-impact-XXXXXX";
+    char *command = NULL, *name = NULL, *file = NULL;
+    size_t name_size = 0, file_size = 0, i;
+    const char *path = module_paths[module], *c;
+    FILE *tmp, *pipe;
+    int fd = mkstemp(tmp_filename), ret = 0;
+    size_t len = 0;
+
+    if (fd < 0 || !(tmp = fdopen(fd, "w"))) {
+        fprintf(stderr, "Could not create a temporary file\n");
+        return -1;
+    }
+    for (i = 0; i < nb_addresses; i++)
+        if (addresses[i].module == module)
+            fprintf(tmp, "0x%"PRIx64"\n", addresses[i].offset);
+    fclose(tmp);
+
+    /* quote the module path for the shell */
+    command = malloc(strlen(path) * 4 + strlen(tmp_filename) + 32);
+    if (!command)
+        out_of_memory();
+    len = sprintf(command, "addr2line -f -e '");
+    for (c = path; *c; c++)
+        len += sprintf(command + len, *c == '\'' ? "'\\''" : "%c", *c);
+    sprintf(command + len, "' < %s", tmp_filename);
+
+    pipe = popen(command, "r");
+    if (!pipe) {
+        fprintf(stderr, "Could not run addr2line\n");
+        ret = -1;
+        goto end;
+    }
+    for (i = 0; i < nb_addresses; i++) {
+        char *colon;
+        if (addresses[i].module != module)
+            continue;
+        if (getline(&name, &name_size, pipe) <= 0 || getline(&file, &file_size, pipe) <= 0) {
+            fprintf(stderr, "addr2line failed for %s\n", path);
+            ret = -1;
+            break;
+        }
+        name[strcspn(name, "\n")] = 0;
+        file[strcspn(file, "\n")] = 0;
+        if ((colon = strrchr(file, ':')))
+            *colon = 0;
+        /* functions without debug info are told apart by module only */
+        addresses[i].function = find_function(name, strcmp(file, "??") ? file : path);
+    }
+    if (pclose(pipe))
+        ret = -1;
+
+end:
+    unlink(tmp_filename);
+    free(command);
+    free(name);
+    free(file);
+    return ret;
+}
+
+static const struct function *sort_functions;
+
+static int cmp_function_name(const void *a, const void *b)
+{
+    const struct function *x = &sort_functions[*(const uint32_t *)a];
+    const struct function *y = &sort_functions[*(const uint32_t *)b];
+    int cmp = strcmp(x->name, y->name);
+    return cmp ? cmp : strcmp(x->file, y->file);
+}
+
+static uint32_t add_string(char **strings, size_t *size, size_t *max, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    uint32_t offset = *size;
+
+    while (*size + len > *max) {
+        *max = *max ? 2 * *max : 65536;
+        *strings = realloc(*strings, *max);
+        if (!*strings)
+            out_of_memory();
+    }
+    memcpy(*strings + *size, s, len);
+    *size += len;
+    return offset;
+}
+
+static int write_index(const char *filename)
+{
+    struct index_header header = { .magic = IMPACT_MAGIC, .version = IMPACT_VERSION };
+    uint32_t *order = malloc((nb_functions + 1) * sizeof(*order));
+    uint32_t *input_names = malloc((nb_inputs + 1) * sizeof(*input_names));
+    uint8_t *postings = NULL;
+    char *strings = NULL;
+    size_t postings_size = 0, max_postings = 0, strings_size = 0, max_strings = 0, i, j;
+    FILE *f;
+
+    if (!order || !input_names)
+        out_of_memory();
+    for (i = 0; i < nb_inputs; i++)
+        input_names[i] = add_string(&strings, &strings_size, &max_strings, inputs[i]);
+    for (i = 0; i < nb_functions; i++)
+        order[i] = i;
+    sort_functions = functions;
+    qsort(order, nb_functions, sizeof(*order), cmp_function_name);
+
+    f = fopen(filename, "wb");
+    if (!f) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return -1;
+    }
+    header.nb_inputs    = nb_inputs;
+    header.nb_functions = nb_functions;
+    fseek(f, sizeof(header) + nb_inputs * sizeof(*input_names), SEEK_SET);
+
+    for (i = 0; i < nb_functions; i++) {
+        const struct function *func = &functions[order[i]];
+        struct index_function record;
+        uint32_t previous = 0;
+
+        record.name      = add_string(&strings, &strings_size, &max_strings, func->name);
+        record.file      = add_string(&strings, &strings_size, &max_strings, func->file);
+        record.postings  = postings_size;
+        record.nb_inputs = func->nb_inputs;
+        fwrite(&record, sizeof(record), 1, f);
+
+        /* ascending input numbers, as varint coded differences */
+        for (j = 0; j < func->nb_inputs; j++) {
+            uint32_t delta = func->inputs[j] - previous;
+            previous = func->inputs[j];
+            do {
+                GROW(postings, postings_size, max_postings);
+                postings[postings_size++] = (delta & 0x7f) | (delta > 0x7f ? 0x80 : 0);
+                delta >>= 7;
+            } while (delta);
+        }
+    }
+    header.postings_size = postings_size;
+    header.strings_size  = strings_size;
+    fwrite(postings, 1, postings_size, f);
+    fwrite(strings, 1, strings_size, f);
+    rewind(f);
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(input_names, sizeof(*input_names), nb_inputs, f);
+
+    free(order);
+    free(input_names);
+    free(postings);
+    free(strings);
+    if (fclose(f)) {
+        fprintf(stderr, "Could not write %s\n", filename);
+        return -1;
+    }
+    printf("Indexed %zu inputs reaching %zu functions into %s\n",
+           nb_inputs, nb_functions, filename);
+    return 0;
+}
+
+static int build_index(const char *index_filename, int nb_logs, char **logs)
+{
+    size_t i;
+    int m;
+
+    for (m = 0; m < nb_logs; m++)
+        if (read_log(logs[m]) < 0)
+            return 1;
+    for (m = 0; m < nb_module_paths; m++)
+        if (symbolise_module(m) < 0)
+            return 1;
+
+    for (i = 0; i < nb_hits; i++) {
+        uint32_t input = hits[i][0], function = addresses[hits[i][1]].function;
+        struct function *f;
+        if (function == UINT32_MAX)
+            continue;
+        f = &functions[function];
+        /* inputs come in order, so a repeat can only be the last one */
+        if (f->nb_inputs && f->inputs[f->nb_inputs - 1] == input)
+            continue;
+        GROW(f->inputs, f->nb_inputs, f->max_inputs);
+        f->inputs[f->nb_inputs++] = input;
+    }
+    return write_index(index_filename) < 0;
+}
+
+/* a changed file matches function files ending in it at a path boundary */
+static int file_matches(const char *file, const char *changed)
+{
+    size_t len = strlen(file), changed_len = strlen(changed);
+
+    if (changed_len > len || strcmp(file + len - changed_len, changed))
+        return 0;
+    return len == changed_len || file[len - changed_len - 1] == '/';
+}
+
+static void select_function(const uint8_t *map, const struct index_function *record,
+                            uint8_t *selected)
+{
+    const struct index_header *header = (const struct index_header *)map;
+    const uint8_t *p = map + sizeof(*header) + header->nb_inputs * sizeof(uint32_t) +
+                       header->nb_functions * sizeof(*record) + record->postings;
+    uint32_t i, input = 0;
+
+    for (i = 0; i < record->nb_inputs; i++) {
+        uint32_t delta = 0;
+        int shift = 0;
+        do {
+            delta |= (uint32_t)(*p & 0x7f) << shift;
+            shift += 7;
+        } while (*p++ & 0x80);
+        input += delta;
+        selected[input] = 1;
+    }
+}
+
+static int select_inputs(const char *index_filename, int nb_changes, char **changes)
+{
+    const struct index_header *header;
+    const struct index_function *records;
+    const uint32_t *input_names;
+    const char *strings;
+    uint8_t *map, *selected;
+    char *line = NULL;
+    size_t line_size = 0;
+    struct stat st;
+    uint32_t i, nb_selected = 0;
+    int fd = open(index_filename, O_RDONLY), c;
+
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*header)) {
+        fprintf(stderr, "Could not open index %s\n", index_filename);
+        return 1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 1;
+    header = (const struct index_header *)map;
+    if (memcmp(header->magic, IMPACT_MAGIC, 8) || header->version != IMPACT_VERSION ||
+        sizeof(*header) + (uint64_t)header->nb_inputs * sizeof(uint32_t) +
+        (uint64_t)header->nb_functions * sizeof(*records) + header->postings_size +
+        header->strings_size > (uint64_t)st.st_size) {
+        fprintf(stderr, "%s is not an impact index\n", index_filename);
+        return 1;
+    }
+    input_names = (const uint32_t *)(map + sizeof(*header));
+    records     = (const struct index_function *)(input_names + header->nb_inputs);
+    strings     = (const char *)records + header->nb_functions * sizeof(*records) +
+                  header->postings_size;
+    selected    = calloc(header->nb_inputs + 1, 1);
+    if (!selected)
+        out_of_memory();
+
+    /* changes from the command line, or one per line from stdin */
+    for (c = 0; nb_changes ? c < nb_changes : getline(&line, &line_size, stdin) > 0; c++) {
+        const char *change = nb_changes ? changes[c] : line;
+        if (!nb_changes)
+            line[strcspn(line, "\n")] = 0;
+        if (!*change)
+            continue;
+        if (strchr(change, '/') || strchr(change, '.')) {
+            for (i = 0; i < header->nb_functions; i++)
+                if (file_matches(strings + records[i].file, change))
+                    select_function(map, &records[i], selected);
+        } else {
+            /* functions are sorted by name, static ones may share it */
+            uint32_t lo = 0, hi = header->nb_functions;
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (strcmp(strings + records[mid].name, change) < 0)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            for (i = lo; i < header->nb_functions && !strcmp(strings + records[i].name, change); i++)
+                select_function(map, &records[i], selected);
+        }
+    }
+
+    for (i = 0; i < header->nb_inputs; i++) {
+        if (selected[i]) {
+            printf("%s\n", strings + input_names[i]);
+            nb_selected++;
+        }
+    }
+    fprintf(stderr, "Selected %u of %u inputs\n", nb_selected, header->nb_inputs);
+    free(selected);
+    free(line);
+    munmap(map, st.st_size);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 4 && !strcmp(argv[1], "build"))
+        return build_index(argv[2], argc - 3, argv + 3);
+    if (argc >= 3 && !strcmp(argv[1], "select"))
+        return select_inputs(argv[2], argc - 3, argv + 3);
+
+    fprintf(stderr, "\n"
+                "usage: %s build index_file log_file...\n"
+                "       %s select index_file [function|source_file...]\n\n"
+                "Builds an index of the functions each input reaches from the logs\n"
+                "written by fffuzz -i, or prints the inputs reaching any of the\n"
+                "changed functions or source files (read from stdin if none given).\n\n",
+                argv[0], argv[0]);
+    return 1;
+}
@@ -28,14 +28,30 @@
  * This can be useful for fuzz testing.
  * @example ddcf.c
  */
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <libavutil/avstring.h>
+#include <libavutil/bprint.h>
+#include <libavutil/file.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/intreadwrite.h>
 #include <libavutil/samplefmt.h>
+#include <libavutil/time.h>
 #include <libavutil/timestamp.h>
 #include <libavformat/avformat.h>
 
+#include "fffuzz.h"
+
+/* decoder threads with -t or -D, fixed so runs reproduce */
+#define DECODER_THREADS "4"
+
+/* room for the crash handler and the sanitizer handler it chains to */
+#define CRASH_STACK_SIZE (256 * 1024)
+
 /* needed for decoding video */
 static int width, height;
 static enum AVPixelFormat pix_fmt;
@@ -43,6 +59,171 @@ static uint8_t *video_dst_data[4] = {NULL};
 static int      video_dst_linesize[4];
 static int video_dst_bufsize;
 
+/* packet being decoded, read by crash_handler() */
+static volatile struct {
+    int64_t index;          ///< packets read so far, -1 before the first one
+    int64_t pos;            ///< pkt.pos, -1 while flushing
+    int     size;
+    int     stream_index;
+} current_packet = { -1, -1, 0, -1 };
+
+/* archive entry being decoded, read by crash_handler() */
+static volatile struct {
+    int     index;          ///< -1 outside archives
+    int64_t offset;         ///< of the entry in the archive, -1 if decompressed
+    int64_t size;
+    const char *name;       ///< as stored in the archive
+} current_entry = { -1, -1, 0, NULL };
+
+static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+static struct sigaction old_crash_actions[FF_ARRAY_ELEMS(crash_signals)];
+static uint8_t crash_stack[CRASH_STACK_SIZE];
+
+/* options shared by every input */
+static char *format      = NULL;
+static char *codec       = NULL;
+static char *thread_mode = NULL;
+static char *profile_prefix = NULL;
+static FILE *bench_report   = NULL;
+static char *golden_filename = NULL;
+static char *index_filename = NULL;
+static int async_output = 0;
+static struct writer *output_writer = NULL;
+static int huge_pages = 0;
+
+enum decoder_state {
+    STATE_RESET,    ///< a new decoder for every input
+    STATE_FLUSH,    ///< one decoder, avcodec_flush_buffers() between inputs
+    STATE_KEEP,     ///< one decoder, inputs spliced without a flush
+};
+static enum decoder_state state_mode = STATE_RESET;
+static AVCodecContext *kept_dec_ctx = NULL;
+
+enum seed_source {
+    SEED_NONE,      ///< threads scheduled by the OS
+    SEED_INPUT,     ///< schedule seeded from a hash of the input
+    SEED_TRAILER,   ///< schedule seeded from the last 8 bytes, not demuxed
+};
+static enum seed_source sched_seed = SEED_NONE;
+
+/* what the decoder does after a packet, picked by the low bits of one
+ * control byte per packet */
+enum control_op {
+    CONTROL_NONE,
+    CONTROL_FLUSH,  ///< avcodec_flush_buffers(), dropping delayed frames
+    CONTROL_DRAIN,  ///< NULL packets until no more frames, then flush
+    CONTROL_RESEND, ///< drain, then decode the same packet again
+};
+static const char *const control_names[] = { "none", "flush", "drain", "resend" };
+static int control_size = 0;
+
+/* text subtitle options of every input (-T), or of each input from a trailer byte */
+enum subtitle_source {
+    SUBTITLES_RAW,      ///< rectangles printed field by field
+    SUBTITLES_FIXED,    ///< ASS events rendered, with the charset given
+    SUBTITLES_TRAILER,  ///< ASS events rendered, options from the input
+};
+static enum subtitle_source subtitle_mode = SUBTITLES_RAW;
+static const char *sub_charenc = NULL;
+static const char *sub_text_format = "ass";
+static AVBPrint sub_events;
+
+/* picked by the low 3 bits of the trailer byte, NULL keeps the input as is */
+static const char *const trailer_charsets[8] = {
+    NULL, "UTF-8", "CP1252", "ISO-8859-15", "UTF-16LE", "SHIFT_JIS", "GB18030", "CP1251"
+};
+
+/* resampling of decoded audio (-r), to fixed parameters or ones picked by
+ * trailer bytes */
+enum resample_source {
+    RESAMPLE_NONE,      ///< the first plane written as decoded
+    RESAMPLE_FIXED,
+    RESAMPLE_TRAILER,
+};
+static enum resample_source resample_mode = RESAMPLE_NONE;
+
+/* set when a decoded frame could not be resampled, written or hashed, which
+ * fails the input */
+static int output_failed;
+
+/* flush latency of the current input */
+static struct {
+    int     count;
+    int64_t total_us;
+    int64_t max_us;
+} control_stats;
+
+/* allocate video_dst_data for width, height and pix_fmt */
+static int alloc_video_dst(void)
+{
+    if (huge_pages)
+        video_dst_bufsize = huge_image_alloc(video_dst_data, video_dst_linesize,
+                                             width, height, pix_fmt);
+    else
+        video_dst_bufsize = av_image_alloc(video_dst_data, video_dst_linesize,
+                                           width, height, pix_fmt, 1);
+    return video_dst_bufsize;
+}
+
+static void free_video_dst(void)
+{
+    /* the hugepage staging buffer is kept for the next input */
+    if (!huge_pages)
+        av_freep(&video_dst_data[0]);
+}
+
+static void bprint_ass_time(AVBPrint *buf, int64_t cs)
+{
+    cs = FFMAX(cs, 0);
+    av_bprintf(buf, "%d:%02d:%02d.%02d", (int)(cs / 360000), (int)(cs / 6000 % 60),
+               (int)(cs / 100 % 60), (int)(cs % 100));
+}
+
+/* the "Dialogue:" lines of sub as an .ass file has them, one per rectangle */
+static void render_ass_events(AVBPrint *buf, const AVSubtitle *sub)
+{
+    int64_t base = sub->pts == AV_NOPTS_VALUE ? 0 : sub->pts / (AV_TIME_BASE / 100);
+    unsigned i;
+
+    av_bprint_clear(buf);
+    for (i = 0; i < sub->num_rects; i++) {
+        const AVSubtitleRect *rect = sub->rects[i];
+        const char *layer, *rest;
+        size_t len;
+
+        if (!rect->ass) {
+            if (rect->text)
+                av_bprintf(buf, "Text: %s\n", rect->text);
+            else
+                av_bprintf(buf, "Bitmap: %d,%d,%dx%d\n", rect->x, rect->y, rect->w, rect->h);
+            continue;
+        }
+        len = strcspn(rect->ass, "\r\n");
+        /* ass_with_timings events are complete lines already */
+        if (av_strstart(rect->ass, "Dialogue:", NULL)) {
+            av_bprint_append_data(buf, rect->ass, len);
+            av_bprint_chars(buf, '\n', 1);
+            continue;
+        }
+        /* ass events are ReadOrder,Layer,Style,...: put the times after Layer */
+        layer = memchr(rect->ass, ',', len);
+        rest = layer ? memchr(layer + 1, ',', len - (layer + 1 - rect->ass)) : NULL;
+        if (!rest) {
+            av_bprint_append_data(buf, rect->ass, len);
+            av_bprint_chars(buf, '\n', 1);
+            continue;
+        }
+        av_bprintf(buf, "Dialogue: ");
+        av_bprint_append_data(buf, layer + 1, rest - layer - 1);
+        av_bprint_chars(buf, ',', 1);
+        bprint_ass_time(buf, base + sub->start_display_time / 10);
+        av_bprint_chars(buf, ',', 1);
+        bprint_ass_time(buf, base + sub->end_display_time / 10);
+        av_bprint_append_data(buf, rest, len - (rest - rect->ass));
+        av_bprint_chars(buf, '\n', 1);
+    }
+}
+
 static int decode_packet(AVCodecContext *dec_ctx, FILE *dst_file, AVFrame *frame, int *got_frame, int *frame_count, AVPacket *pkt)
 {
     int ret = -1;
@@ -61,6 +242,19 @@ static int decode_packet(AVCodecContext *dec_ctx, FILE *dst_file, AVFrame *frame
 
         if (*got_frame) {
 
+            if (state_mode != STATE_RESET && (frame->width != width ||
+                frame->height != height || frame->format != pix_fmt)) {
+                /* spliced inputs may change size or format */
+                free_video_dst();
+                width = frame->width;
+                height = frame->height;
+                pix_fmt = frame->format;
+                if (alloc_video_dst() < 0) {
+                    fprintf(stderr, "Could not allocate raw video buffer\n");
+                    return -1;
+                }
+            }
+
             if (frame->width != width || frame->height != height ||
                 frame->format != pix_fmt) {
                 fprintf(stderr, "Error: input video width/height/format changed:\n"
@@ -72,19 +266,31 @@ static int decode_packet(AVCodecContext *dec_ctx, FILE *dst_file, AVFrame *frame
                 return -1;
             }
 
+            enum stage stage = stage_enter(STAGE_OUTPUT);
+
             printf("video_frame n:%d coded_n:%d pts:%s\n",
                    *frame_count, frame->coded_picture_number,
                    av_ts2timestr(frame->pts, &dec_ctx->time_base));
 
-            /* copy decoded frame to destination buffer:
-             * this is required since rawvideo expects non aligned data */
-            av_image_copy(video_dst_data, video_dst_linesize,
-                          (const uint8_t **)(frame->data), frame->linesize,
-                          pix_fmt, width, height);
             *frame_count += 1;
 
-            /* write to rawvideo file */
-            fwrite(video_dst_data[0], 1, video_dst_bufsize, dst_file);
+            if (output_writer) {
+                /* the writer thread writes from the frame buffers */
+                if (writer_write_frame(output_writer, frame, AVMEDIA_TYPE_VIDEO) < 0)
+                    output_failed = 1;
+            } else {
+                /* copy decoded frame to destination buffer:
+                 * this is required since rawvideo expects non aligned data */
+                av_image_copy(video_dst_data, video_dst_linesize,
+                              (const uint8_t **)(frame->data), frame->linesize,
+                              pix_fmt, width, height);
+
+                /* write to rawvideo file */
+                fwrite(video_dst_data[0], 1, video_dst_bufsize, dst_file);
+            }
+            if (golden_filename && golden_queue_frame(frame, AVMEDIA_TYPE_VIDEO) < 0)
+                output_failed = 1;
+            stage_enter(stage);
         }
     } else if (dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
         ret = 0;
@@ -102,6 +308,7 @@ static int decode_packet(AVCodecContext *dec_ctx, FILE *dst_file, AVFrame *frame
 
         if (*got_frame) {
             size_t unpadded_linesize = frame->nb_samples * av_get_bytes_per_sample(frame->format);
+            enum stage stage = stage_enter(STAGE_OUTPUT);
             printf("audio_frame n:%d nb_samples:%d pts:%s\n",
                    *frame_count, frame->nb_samples,
                    av_ts2timestr(frame->pts, &dec_ctx->time_base));
@@ -114,8 +321,19 @@ static int decode_packet(AVCodecContext *dec_ctx, FILE *dst_file, AVFrame *frame
              * In other words, this code will write only the first audio channel
              * in these cases.
              * You should use libswresample or libavfilter to convert the frame
-             * to packed data. */
-            fwrite(frame->extended_data[0], 1, unpadded_linesize, dst_file);
+             * to packed data, as -r does. */
+            if (resample_mode != RESAMPLE_NONE) {
+                if (resample_frame(frame, dst_file) < 0)
+                    output_failed = 1;
+            } else if (output_writer) {
+                if (writer_write_frame(output_writer, frame, AVMEDIA_TYPE_AUDIO) < 0)
+                    output_failed = 1;
+            } else {
+                fwrite(frame->extended_data[0], 1, unpadded_linesize, dst_file);
+            }
+            if (golden_filename && golden_queue_frame(frame, AVMEDIA_TYPE_AUDIO) < 0)
+                output_failed = 1;
+            stage_enter(stage);
         }
     } else if (dec_ctx->codec_type == AVMEDIA_TYPE_SUBTITLE) {
         ret = 0;
@@ -127,6 +345,7 @@ static int decode_packet(AVCodecContext *dec_ctx, FILE *dst_file, AVFrame *frame
         }
 
         if (*got_frame) {
+            enum stage stage = stage_enter(STAGE_OUTPUT);
 
             printf("subtitle n:%d format:%u pts:%s start_time:%u end_time:%u num_recs:%u\n",
                    *frame_count, sub.format,
@@ -135,6 +354,19 @@ static int decode_packet(AVCodecContext *dec_ctx, FILE *dst_file, AVFrame *frame
 
             *frame_count += 1;
 
+            if (subtitle_mode != SUBTITLES_RAW) {
+                /* one write and one hash of the rendered events */
+                render_ass_events(&sub_events, &sub);
+                fwrite(sub_events.str, 1, sub_events.len, dst_file);
+                if (golden_filename &&
+                    golden_add_frame(golden_hash_data((const uint8_t *)sub_events.str,
+                                                      sub_events.len)) < 0)
+                    output_failed = 1;
+                avsubtitle_free(&sub);
+                stage_enter(stage);
+                goto end;
+            }
+
             /* write to text file */
             for (i = 0; i < sub.num_rects; i += 1) {
                 fprintf(dst_file, "x:%d y:%d w:%d h:%d nb_colors:%d flags:%x linesizes:%d,%d,%d,%d,%d,%d,%d,%d\n"
@@ -158,57 +390,231 @@ static int decode_packet(AVCodecContext *dec_ctx, FILE *dst_file, AVFrame *frame
                     }
                 }
             }
+            if (golden_filename && golden_add_frame(golden_hash_subtitle(&sub)) < 0)
+                output_failed = 1;
             avsubtitle_free(&sub);
+            stage_enter(stage);
         }
     }
 
+end:
     /* de-reference the frame, which is not used anymore */
     if (*got_frame)
         av_frame_unref(frame);
 
+    if (output_failed) {
+        *got_frame = 0;
+        return AVERROR(EIO);
+    }
     return ret;
 }
 
-static int open_codec_context(AVCodecContext **dec_ctx, AVFormatContext *fmt_ctx, char *codec)
+/* decode all of pkt, which may take several calls for audio */
+static void decode_all(AVCodecContext *dec_ctx, FILE *dst_file, AVFrame *frame,
+                       int *got_frame, int *frame_count, AVPacket pkt)
+{
+    do {
+        int decoded = decode_packet(dec_ctx, dst_file, frame, got_frame, frame_count, &pkt);
+        if (decoded < 0)
+            break;
+        /* increase data pointer and decrease size of remaining data buffer */
+        pkt.data += decoded;
+        pkt.size -= decoded;
+    } while (pkt.size > 0);
+}
+
+/* as a player does on a seek or discontinuity, after pkt was decoded;
+ * the latency is the time until the decoder takes the next packet */
+static void control_decoder(enum control_op op, AVCodecContext *dec_ctx, FILE *dst_file,
+                            AVFrame *frame, int *frame_count, AVPacket *pkt)
+{
+    AVPacket drain = { 0 };
+    int64_t start = av_gettime_relative(), latency;
+    int got_frame, nb_frames = *frame_count;
+
+    if (op == CONTROL_NONE)
+        return;
+    if (op != CONTROL_FLUSH) {
+        current_packet.pos = -1;
+        current_packet.size = 0;
+        do {
+            decode_packet(dec_ctx, dst_file, frame, &got_frame, frame_count, &drain);
+        } while (got_frame);
+    }
+    avcodec_flush_buffers(dec_ctx);
+    latency = av_gettime_relative() - start;
+
+    printf("control n:%"PRId64" op:%s frames:%d latency_us:%"PRId64"\n",
+           current_packet.index, control_names[op], *frame_count - nb_frames, latency);
+    control_stats.count++;
+    control_stats.total_us += latency;
+    control_stats.max_us = FFMAX(control_stats.max_us, latency);
+
+    if (op == CONTROL_RESEND) {
+        current_packet.pos = pkt->pos;
+        current_packet.size = pkt->size;
+        decode_all(dec_ctx, dst_file, frame, &got_frame, frame_count, *pkt);
+    }
+}
+
+static char *append_int64(char *p, const char *label, int64_t value)
+{
+    char digits[20];
+    uint64_t v = value < 0 ? -(uint64_t)value : value;
+    int n = 0;
+
+    while (*label)
+        *p++ = *label++;
+    if (value < 0)
+        *p++ = '-';
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n)
+        *p++ = digits[--n];
+    return p;
+}
+
+/**
+ * Report the packet being decoded when the harness crashes, so that a
+ * triage script can cut the input right after it. Only async-signal-safe
+ * calls are used; the previous handler (e.g. the sanitizer's) runs after.
+ */
+static void crash_handler(int sig, siginfo_t *info, void *context)
+{
+    char line[192], *p = line;
+    unsigned i;
+
+    p = append_int64(p, "fffuzz crash: signal:", sig);
+    p = append_int64(p, " packet:", current_packet.index);
+    p = append_int64(p, " pos:", current_packet.pos);
+    p = append_int64(p, " size:", current_packet.size);
+    p = append_int64(p, " stream:", current_packet.stream_index);
+    if (current_entry.index >= 0) {
+        p = append_int64(p, " entry:", current_entry.index);
+        p = append_int64(p, " offset:", current_entry.offset);
+        p = append_int64(p, " length:", current_entry.size);
+    }
+    write(STDERR_FILENO, line, p - line);
+    /* last, as it may hold spaces; a decompressed entry is extracted by name */
+    if (current_entry.index >= 0 && current_entry.name) {
+        write(STDERR_FILENO, " name:", 6);
+        write(STDERR_FILENO, current_entry.name, strlen(current_entry.name));
+    }
+    write(STDERR_FILENO, "\n", 1);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(crash_signals); i++)
+        if (crash_signals[i] == sig)
+            sigaction(sig, &old_crash_actions[i], NULL);
+    /* a fault raised by the kernel happens again once we return */
+    if (info->si_code <= 0)
+        raise(sig);
+}
+
+static void install_crash_handler(void)
+{
+    struct sigaction action = { 0 };
+    stack_t stack = { .ss_sp = crash_stack, .ss_size = sizeof(crash_stack) };
+    unsigned i;
+
+    /* a stack overflow of the main thread leaves no stack for the handler;
+     * decoder threads overflowing still die without a report */
+    if (sigaltstack(&stack, NULL) < 0)
+        fprintf(stderr, "Could not set the crash handler stack (%s)\n", strerror(errno));
+    action.sa_sigaction = crash_handler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for (i = 0; i < FF_ARRAY_ELEMS(crash_signals); i++)
+        sigaction(crash_signals[i], &action, &old_crash_actions[i]);
+}
+
+static AVCodecContext *find_stream_context(AVFormatContext *fmt_ctx, AVCodec *dec)
 {
-    int ret = -1;
-    AVCodec *dec = avcodec_find_decoder_by_name(codec);
-    AVDictionary *opts = NULL;
     unsigned int i;
 
     for (i = 0; i < fmt_ctx->nb_streams && i < INT_MAX; i += 1) {
         if (fmt_ctx->streams[i]->codec) {
-            if (!dec || (fmt_ctx->streams[i]->codec->codec_id == dec->id)) {
-                *dec_ctx = fmt_ctx->streams[i]->codec;
-                ret = 0;
-                break;
-            }
+            if (!dec || (fmt_ctx->streams[i]->codec->codec_id == dec->id))
+                return fmt_ctx->streams[i]->codec;
         }
     }
+    return NULL;
+}
+
+static int open_decoder(AVCodecContext *dec_ctx, AVCodec *dec, char *codec)
+{
+    AVDictionary *opts = NULL;
+    int ret;
+
+    /* Init the decoders, with or without reference counting */
+    av_dict_set(&opts, "refcounted_frames", "1", 0);
+    av_dict_set(&opts, "strict", "-2", 0);
+    av_dict_set(&opts, "codec_whitelist", codec, 0);
+    av_dict_set(&opts, "thread_type", thread_mode ? thread_mode : "slice", 0);
+    /* threads defaults to 1, which leaves the thread type without effect */
+    if (thread_mode || sched_seed != SEED_NONE)
+        av_dict_set(&opts, "threads", DECODER_THREADS, 0);
+    if (huge_pages && dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO &&
+        dec->capabilities & AV_CODEC_CAP_DR1) {
+        /* frame threads call it from their own threads; huge_get_buffer2()
+         * takes the pool lock, so it is safe to let them */
+        dec_ctx->get_buffer2 = huge_get_buffer2;
+        dec_ctx->thread_safe_callbacks = 1;
+    }
+    if (subtitle_mode != SUBTITLES_RAW && dec_ctx->codec_type == AVMEDIA_TYPE_SUBTITLE) {
+        printf("Subtitle charset %s, text format %s\n",
+               sub_charenc ? sub_charenc : "unchanged", sub_text_format);
+        av_dict_set(&opts, "sub_charenc", sub_charenc, 0);
+        av_dict_set(&opts, "sub_text_format", sub_text_format, 0);
+    }
+    if ((ret = avcodec_open2(dec_ctx, dec, &opts)) < 0) {
+        fprintf(stderr, "Failed to open decoder\n");
+    }
+    av_dict_free(&opts);
+    return ret;
+}
+
+static int open_codec_context(AVCodecContext **dec_ctx, AVFormatContext *fmt_ctx, char *codec)
+{
+    AVCodec *dec = avcodec_find_decoder_by_name(codec);
+    AVCodecContext *stream_ctx = find_stream_context(fmt_ctx, dec);
 
-    if (ret < 0) {
+    if (!stream_ctx) {
         fprintf(stderr, "Could not find stream\n");
-    } else {
-        /* find decoder for the stream */
-        if (!dec)
-            dec = avcodec_find_decoder((*dec_ctx)->codec_id);
-        if (!dec) {
-            fprintf(stderr, "Failed to find decoder\n");
-            return -1;
-        }
+        return -1;
+    }
 
-        /* Init the decoders, with or without reference counting */
-        av_dict_set(&opts, "refcounted_frames", "1", 0);
-        av_dict_set(&opts, "strict", "-2", 0);
-        av_dict_set(&opts, "codec_whitelist", codec, 0);
-        av_dict_set(&opts, "thread_type", "slice", 0);
-        if ((ret = avcodec_open2(*dec_ctx, dec, &opts)) < 0) {
-            fprintf(stderr, "Failed to open decoder\n");
-        }
-        av_dict_free(&opts);
+    /* find decoder for the stream */
+    if (!dec)
+        dec = avcodec_find_decoder(stream_ctx->codec_id);
+    if (!dec) {
+        fprintf(stderr, "Failed to find decoder\n");
+        return -1;
     }
 
-    return ret;
+    if (state_mode == STATE_RESET) {
+        *dec_ctx = stream_ctx;
+        return open_decoder(stream_ctx, dec, codec);
+    }
+
+    /* keep a decoder of our own, which outlives the format context, for as
+     * long as the inputs use the same codec */
+    if (kept_dec_ctx && kept_dec_ctx->codec_id == dec->id) {
+        if (state_mode == STATE_FLUSH)
+            avcodec_flush_buffers(kept_dec_ctx);
+        *dec_ctx = kept_dec_ctx;
+        return 0;
+    }
+    avcodec_free_context(&kept_dec_ctx);
+    kept_dec_ctx = avcodec_alloc_context3(dec);
+    if (!kept_dec_ctx || avcodec_copy_context(kept_dec_ctx, stream_ctx) < 0 ||
+        open_decoder(kept_dec_ctx, dec, codec) < 0) {
+        avcodec_free_context(&kept_dec_ctx);
+        return -1;
+    }
+    *dec_ctx = kept_dec_ctx;
+    return 0;
 }
 
 void exit_with_usage_msg(char* prog_name)
@@ -225,23 +631,508 @@ void exit_with_usage_msg(char* prog_name)
                 "-c codec\n"
                 "\tSets the decode codec\n"
                 "-t slice|frame\n"
-                "\tSets threading mode (slice or frame threads)\n\n", prog_name);
+                "\tSets threading mode (slice or frame threads), with " DECODER_THREADS " threads\n"
+                "-M decode|minimize|generate|encode|mux|roundtrip|scale|scalebench|serve\n"
+                "\tSets the mode: decode input_file (default), shrink a slow\n"
+                "\tinput_file into output_file while keeping it slow, encode\n"
+                "\ta benchmark corpus for the number input_file as seed into the\n"
+                "\tdirectory output_file, encode the raw frames in input_file\n"
+                "\twith the -c encoder, or mux the packets in input_file with the\n"
+                "\t-f muxer into memory, and demux them again for roundtrip, or\n"
+                "\tscale the image in input_file, repeatedly for scalebench, or\n"
+                "\tserve decode jobs on the Unix socket input_file, writing to\n"
+                "\toutput_file.worker unless a job names its output\n"
+                "-O cpu|rss\n"
+                "\tSets what minimize keeps: CPU time (default) or peak memory\n"
+                "-P profile_prefix\n"
+                "\tSamples the decode loop and writes a flat profile of all\n"
+                "\titerations to profile_prefix.codec.prof\n"
+                "-B report_file\n"
+                "\tWrites wall time, cycles, instructions, LLC and branch misses\n"
+                "\tper stage (open, probe, decode, output) per input and per run,\n"
+                "\tand dTLB load misses\n"
+                "-g golden_db\n"
+                "\tCompares the hashes of the decoded frames with golden_db\n"
+                "-u golden_db\n"
+                "\tStores the hashes of the decoded frames in golden_db\n"
+                "-a zip|tar|batch\n"
+                "\tDecodes every file in the input_file archive, without extracting,\n"
+                "\tor every input of a batch testcase (inputs joined by " BATCH_SEPARATOR ")\n"
+                "-i index_log\n"
+                "\tAppends the functions each input reaches to index_log, for\n"
+                "\tfffuzz-impact (needs ./build.sh index)\n"
+                "-w stdio|async\n"
+                "\tWrites video and audio output with fwrite (default), or on a\n"
+                "\twriter thread straight from the frame buffers\n"
+                "-H hash_threads\n"
+                "\tHashes frames for -g/-u on hash_threads threads\n"
+                "-s reset|flush|none\n"
+                "\tOpens a new decoder for every input (default), or keeps one\n"
+                "\tdecoder across inputs, flushing it or not in between\n"
+                "-D input|trailer\n"
+                "\tRuns the decoder threads one at a time in an order picked by a\n"
+                "\tseed: a hash of the input, or its last 8 bytes, which are then\n"
+                "\tnot demuxed\n"
+                "-l malloc|huge\n"
+                "\tAllocates video frames and the rawvideo buffer with av_malloc\n"
+                "\t(default), or from a pool of 2 MB pages kept across inputs\n"
+                "-F control_bytes\n"
+                "\tTakes the last control_bytes bytes of the input (before a -D\n"
+                "\ttrailer) as one control byte per packet, which flushes, drains\n"
+                "\tor drains and resends the packet, and reports the latency\n"
+                "-T charset|trailer\n"
+                "\tConverts text subtitles from charset, or from the charset and\n"
+                "\tASS format picked by the input's last byte (before -F and -D\n"
+                "\ttrailers, only with -s reset), and writes and hashes them as\n"
+                "\tASS event lines\n"
+                "-r rate:layout:format|trailer\n"
+                "\tResamples decoded audio with libswresample to all channels of\n"
+                "\te.g. 44100:stereo:s16, or to the rate, layout, format and filter\n"
+                "\tpicked by the input's last 4 bytes (before -T, -F and -D\n"
+                "\ttrailers), and reports the samples per second\n"
+                "-j workers\n"
+                "\tForks workers for -M serve (default: one per CPU)\n\n", prog_name);
     exit(1);
 }
 
+/**
+ * Verify the value passed with an option which takes one of a few names.
+ *
+ * @return the index of value in the NULL-terminated names; exits with the
+ *         usage message if it is not one of them
+ */
+static int parse_choice(char *prog_name, const char *value, char option, const char *what,
+                        const char *const *names)
+{
+    int i;
+
+    for (i = 0; names[i]; i++)
+        if (!strcmp(value, names[i]))
+            return i;
+    fprintf(stderr,
+                "%s: wrong %s passed using -%c flag\n",
+                prog_name, what, option);
+    exit_with_usage_msg(prog_name);
+    return -1;
+}
+
+int memory_read(void *opaque, uint8_t *buf, int buf_size)
+{
+    struct memory_input *in = opaque;
+
+    if (in->pos >= in->size)
+        return AVERROR_EOF;
+    buf_size = FFMIN((size_t)buf_size, in->size - in->pos);
+    memcpy(buf, in->data + in->pos, buf_size);
+    in->pos += buf_size;
+    return buf_size;
+}
+
+int64_t memory_seek(void *opaque, int64_t offset, int whence)
+{
+    struct memory_input *in = opaque;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return in->size;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += in->pos;
+        break;
+    case SEEK_END:
+        offset += in->size;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (offset < 0 || offset > (int64_t)in->size)
+        return AVERROR(EINVAL);
+    in->pos = offset;
+    return offset;
+}
+
+int decode_input(const char *src_filename, const char *dst_filename)
+{
+    uint8_t *data;
+    size_t size;
+    int ret;
+
+    if (sched_seed == SEED_NONE && !control_size && subtitle_mode != SUBTITLES_TRAILER &&
+        resample_mode != RESAMPLE_TRAILER)
+        return decode_input_data(src_filename, NULL, 0, dst_filename);
+
+    /* the schedule seed, control bytes, subtitle and resampler options come
+     * from the input bytes */
+    if (av_file_map(src_filename, &data, &size, 0, NULL) < 0) {
+        fprintf(stderr, "Could not read source file %s\n", src_filename);
+        return 1;
+    }
+    ret = decode_input_data(src_filename, data, size, dst_filename);
+    av_file_unmap(data, size);
+    return ret;
+}
+
+/* one -M serve job, with the options the client sent in place of -f, -c and -t */
+static int decode_job(const char *name, const uint8_t *data, size_t size,
+                      const char *dst_filename, AVDictionary *options)
+{
+    AVDictionaryEntry *job_format  = av_dict_get(options, "format", NULL, 0);
+    AVDictionaryEntry *job_codec   = av_dict_get(options, "codec", NULL, 0);
+    AVDictionaryEntry *job_threads = av_dict_get(options, "threads", NULL, 0);
+    char *saved_format = format, *saved_codec = codec, *saved_threads = thread_mode;
+    int ret;
+
+    if (job_threads && strcmp(job_threads->value, "frame") &&
+        strcmp(job_threads->value, "slice")) {
+        fprintf(stderr, "Wrong thread mode %s in job %s\n", job_threads->value, name);
+        return 1;
+    }
+    if (job_format)
+        format = job_format->value;
+    if (job_codec)
+        codec = job_codec->value;
+    if (job_threads)
+        thread_mode = job_threads->value;
+    ret = decode_input_data(name, data, size, dst_filename);
+    format      = saved_format;
+    codec       = saved_codec;
+    thread_mode = saved_threads;
+    return ret;
+}
+
+static uint64_t schedule_seed(const uint8_t *data, size_t *size)
+{
+    uint64_t seed = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    if (sched_seed == SEED_TRAILER) {
+        if (*size < 8)
+            return 0;
+        *size -= 8;
+        return AV_RL64(data + *size);
+    }
+    for (i = 0; i < *size; i++)
+        seed = (seed ^ data[i]) * 0x100000001b3ULL;
+    return seed;
+}
+
+int decode_input_data(const char *src_filename, const uint8_t *data, size_t size,
+                      const char *dst_filename)
+{
+    AVFormatContext *fmt_ctx = NULL;
+    AVInputFormat *fmt       = NULL;
+    AVCodecContext *dec_ctx  = NULL;
+    FILE *dst_file           = NULL;
+    AVFrame *frame           = NULL;
+    int got_frame            = 0;
+    int frame_count          = 0;
+    AVPacket pkt             = { 0 };
+    AVDictionary *opts       = NULL;
+    AVIOContext *avio_ctx    = NULL;
+    struct memory_input mem  = { data, size, 0 };
+    const uint8_t *control   = NULL;
+    size_t nb_control        = 0, next_control = 0;
+    int ret                  = 0;
+    output_failed = 0;
+    current_packet.index = -1;
+    current_packet.pos = -1;
+    current_packet.size = 0;
+    current_packet.stream_index = -1;
+    width = 0;
+    height = 0;
+    pix_fmt = AV_PIX_FMT_NONE;
+    video_dst_bufsize = 0;
+    memset(video_dst_data, 0, sizeof(video_dst_data));
+    memset(video_dst_linesize, 0, sizeof(video_dst_linesize));
+
+    if (index_filename)
+        func_index_begin_input();
+
+    if (sched_seed != SEED_NONE) {
+        uint64_t seed = data ? schedule_seed(data, &size) : 0;
+        mem.size = size;
+        printf("Scheduling threads with seed %016"PRIx64"\n", seed);
+        sched_begin(seed);
+    }
+
+    if (control_size && data) {
+        /* the control bytes come right before a seed trailer */
+        nb_control = FFMIN(size, (size_t)control_size);
+        size -= nb_control;
+        control = data + size;
+        mem.size = size;
+    }
+    memset(&control_stats, 0, sizeof(control_stats));
+
+    if (subtitle_mode == SUBTITLES_TRAILER && data) {
+        uint8_t options = size ? data[--size] : 0;
+        sub_charenc = trailer_charsets[options & 7];
+        sub_text_format = options & 8 ? "ass_with_timings" : "ass";
+        mem.size = size;
+    }
+
+    if (resample_mode == RESAMPLE_TRAILER && data) {
+        uint8_t options[RESAMPLE_TRAILER_SIZE] = { 0 };
+        size_t nb_options = FFMIN(size, (size_t)RESAMPLE_TRAILER_SIZE);
+        size -= nb_options;
+        memcpy(options, data + size, nb_options);
+        resample_pick_output(options);
+        mem.size = size;
+    }
+
+    if (golden_filename && golden_begin_input(src_filename, data, size) < 0) {
+        fprintf(stderr, "Could not hash source file %s\n", src_filename);
+        ret = 1;
+        goto end;
+    }
+
+    /* set the whitelists for formats and codecs */
+    if (av_dict_set(&opts, "codec_whitelist", codec, 0) < 0) {
+        fprintf(stderr, "Could not set codec_whitelist.\n");
+        ret = 1;
+        goto end;
+    }
+    if (av_dict_set(&opts, "format_whitelist", format, 0) < 0) {
+        fprintf(stderr, "Could not set format_whitelist.\n");
+        ret = 1;
+        goto end;
+    }
+    /* set threading mode */
+    if (av_dict_set(&opts, "thread_type", thread_mode, 0) < 0) {
+        fprintf(stderr, "Could not set thread_type.\n");
+        ret = 1;
+        goto end;
+    }
+
+    if (format) {
+        fmt = av_find_input_format(format);
+        if (!fmt) {
+            fprintf(stderr, "Could not find input format %s\n", format);
+            ret = 1;
+            goto end;
+        }
+    }
+
+    /* open input file, and allocate format context */
+    stage_enter(STAGE_OPEN);
+    if (data) {
+        /* read the input from memory, src_filename only names it */
+        uint8_t *avio_buffer = av_malloc(MEMORY_IO_BUFFER_SIZE);
+        if (avio_buffer)
+            avio_ctx = avio_alloc_context(avio_buffer, MEMORY_IO_BUFFER_SIZE, 0, &mem,
+                                          memory_read, NULL, memory_seek);
+        if (!avio_ctx)
+            av_free(avio_buffer);
+        fmt_ctx = avformat_alloc_context();
+        if (!avio_ctx || !fmt_ctx) {
+            fprintf(stderr, "Could not allocate memory input for %s\n", src_filename);
+            ret = 1;
+            goto end;
+        }
+        fmt_ctx->pb = avio_ctx;
+        fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    if (avformat_open_input(&fmt_ctx, src_filename, fmt, &opts) < 0) {
+        fprintf(stderr, "Could not open source file %s\n", src_filename);
+        ret = 1;
+        goto end;
+    }
+
+    /* retrieve stream information */
+    stage_enter(STAGE_PROBE);
+    if (avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+        fprintf(stderr, "Could not find stream information\n");
+    }
+
+    /* find stream with specified codec */
+    stage_enter(STAGE_OPEN);
+    if (open_codec_context(&dec_ctx, fmt_ctx, codec) < 0) {
+        fprintf(stderr, "Could not open any stream in input file '%s'\n",
+                src_filename);
+        ret = 1;
+        goto end;
+    }
+
+    /* open output file */
+    dst_file = fopen(dst_filename, "wb");
+    if (!dst_file) {
+        fprintf(stderr, "Could not open destination file %s\n", dst_filename);
+        ret = 1;
+        goto end;
+    }
+
+    /* subtitles are text and resampled audio is in the resampler's buffer,
+     * they stay on stdio */
+    if (async_output && dec_ctx->codec_type != AVMEDIA_TYPE_SUBTITLE &&
+        !(resample_mode != RESAMPLE_NONE && dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO)) {
+        output_writer = writer_open(fileno(dst_file));
+        if (!output_writer) {
+            ret = 1;
+            goto end;
+        }
+    }
+
+    if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        /* allocate image where the decoded image will be put */
+        width = dec_ctx->width;
+        height = dec_ctx->height;
+        pix_fmt = dec_ctx->pix_fmt;
+        if (alloc_video_dst() < 0) {
+            fprintf(stderr, "Could not allocate raw video buffer\n");
+            ret = 1;
+            goto end;
+        }
+    }
+
+    /* dump input information to stderr */
+    av_dump_format(fmt_ctx, 0, src_filename, 0);
+
+    /* allocate frame */
+    frame = av_frame_alloc();
+    if (!frame) {
+        fprintf(stderr, "Could not allocate frame\n");
+        ret = 1;
+        goto end;
+    }
+
+    printf("Demuxing from file '%s' into '%s'\n", src_filename, dst_filename);
+
+    if (profile_prefix)
+        profile_start();
+
+    /* read frames from the file */
+    stage_enter(STAGE_DECODE);
+    while (!output_failed && av_read_frame(fmt_ctx, &pkt) >= 0) {
+        current_packet.index++;
+        current_packet.pos = pkt.pos;
+        current_packet.size = pkt.size;
+        current_packet.stream_index = pkt.stream_index;
+        decode_all(dec_ctx, dst_file, frame, &got_frame, &frame_count, pkt);
+        if (next_control < nb_control)
+            control_decoder(control[next_control++] & 3, dec_ctx, dst_file,
+                            frame, &frame_count, &pkt);
+        av_free_packet(&pkt);
+    }
+
+    /* a kept decoder goes on with the next input instead */
+    if (state_mode == STATE_RESET) {
+        printf("Flushing cached frames.\n");
+        pkt.data = NULL;
+        pkt.size = 0;
+        current_packet.pos = -1;
+        current_packet.size = 0;
+        do {
+            decode_packet(dec_ctx, dst_file, frame, &got_frame, &frame_count, &pkt);
+        } while (got_frame);
+    }
+
+    if (profile_prefix)
+        profile_stop();
+
+    printf("Demuxing done.\n");
+    if (output_failed) {
+        fprintf(stderr, "Could not resample, write or hash the output of %s\n",
+                src_filename);
+        ret = 1;
+    }
+
+end:
+    /* free allocated memory */
+    av_dict_free(&opts);
+    if (dec_ctx != kept_dec_ctx)
+        avcodec_close(dec_ctx);
+    if (sched_seed != SEED_NONE)
+        sched_end();
+    avformat_close_input(&fmt_ctx);
+    if (avio_ctx) {
+        av_freep(&avio_ctx->buffer);
+        av_freep(&avio_ctx);
+    }
+    if (writer_close(&output_writer) < 0)
+        ret = 1;
+    if (resample_mode != RESAMPLE_NONE)
+        resample_end_input(src_filename, dst_file, bench_report);
+    if (dst_file)
+        fclose(dst_file);
+    av_frame_free(&frame);
+    free_video_dst();
+
+    if (bench_report) {
+        stage_report_input(bench_report, src_filename);
+        if (control_stats.count)
+            fprintf(bench_report, "control:%s count:%d total_us:%"PRId64" max_us:%"PRId64"\n",
+                    src_filename, control_stats.count, control_stats.total_us,
+                    control_stats.max_us);
+    }
+    if (golden_filename && golden_end_input(src_filename) < 0)
+        ret = 1;
+    if (index_filename)
+        func_index_end_input(src_filename);
+
+    return ret;
+}
+
+static int decode_archive(const char *src_filename, enum archive_type type,
+                          const char *dst_filename)
+{
+    struct archive *archive = archive_open(src_filename, type);
+    struct archive_entry entry;
+    int nb_entries = 0, nb_failed = 0, ret;
+
+    if (!archive)
+        return 1;
+    while ((ret = archive_next(archive, &entry)) > 0) {
+        current_entry.index  = nb_entries;
+        current_entry.offset = entry.offset;
+        current_entry.size   = entry.size;
+        current_entry.name   = entry.name;
+        nb_failed += decode_input_data(entry.name, entry.data, entry.size, dst_filename) != 0;
+        nb_entries++;
+        current_entry.name = NULL;
+        archive_entry_free(&entry);
+    }
+    current_entry.index = -1;
+    archive_close(&archive);
+
+    printf("Decoded %d entries of '%s', %d could not be decoded\n",
+           nb_entries, src_filename, nb_failed);
+    return ret < 0;
+}
+
 int main (int argc, char **argv)
 {
     int ret = 0, current_arg;
     char option;
     const char *src_filename = NULL;
     const char *dst_filename = NULL;
-    char* format             = NULL;
-    char* codec              = NULL;
-    char* thread_mode        = NULL;
+    char* mode               = NULL;
+    char* objective          = NULL;
+    char* bench_filename     = NULL;
+    int golden_update        = 0;
+    char* archive            = NULL;
+    char* writer_mode        = NULL;
+    char* state              = NULL;
+    char* seed_source        = NULL;
+    char* allocator          = NULL;
+    char* subtitles          = NULL;
+    char* resample           = NULL;
+    int hash_threads         = 0;
+    int nb_workers           = 0;
     char* arg                = NULL;
     char* parameter          = NULL;
-    char frame_threads[]     = "frame";
-    char slice_threads[]     = "slice";
+    static const char *const thread_modes[] = { "frame", "slice", NULL };
+    static const char *const modes[]        = {
+        "decode", "minimize", "generate", "encode", "mux", "roundtrip", "scale",
+        "scalebench", "serve", NULL
+    };
+    static const char *const objectives[]   = { "cpu", "rss", NULL };
+    static const char *const archives[]     = { "zip", "tar", "batch", NULL };
+    static const char *const writers[]      = { "stdio", "async", NULL };
+    /* in the order of enum decoder_state */
+    static const char *const states[]       = { "reset", "flush", "none", NULL };
+    static const char *const seed_sources[] = { "input", "trailer", NULL };
+    static const char *const allocators[]   = { "malloc", "huge", NULL };
 
     if (argc < 3) {
         fprintf(stderr,
@@ -284,6 +1175,74 @@ int main (int argc, char **argv)
             case 't':
                 thread_mode = parameter;
                 break;
+            case 'M':
+                mode = parameter;
+                break;
+            case 'O':
+                objective = parameter;
+                break;
+            case 'P':
+                profile_prefix = parameter;
+                break;
+            case 'B':
+                bench_filename = parameter;
+                break;
+            case 'a':
+                archive = parameter;
+                break;
+            case 'i':
+                index_filename = parameter;
+                break;
+            case 'w':
+                writer_mode = parameter;
+                break;
+            case 's':
+                state = parameter;
+                break;
+            case 'D':
+                seed_source = parameter;
+                break;
+            case 'l':
+                allocator = parameter;
+                break;
+            case 'T':
+                subtitles = parameter;
+                break;
+            case 'r':
+                resample = parameter;
+                break;
+            case 'F':
+                control_size = atoi(parameter);
+                if (control_size < 1 || control_size > 65536) {
+                    fprintf(stderr,
+                                "%s: wrong control byte count passed using -F flag\n",
+                                argv[0]);
+                    exit_with_usage_msg(argv[0]);
+                }
+                break;
+            case 'H':
+                hash_threads = atoi(parameter);
+                if (hash_threads < 1 || hash_threads > 64) {
+                    fprintf(stderr,
+                                "%s: wrong hash thread count passed using -H flag\n",
+                                argv[0]);
+                    exit_with_usage_msg(argv[0]);
+                }
+                break;
+            case 'j':
+                nb_workers = atoi(parameter);
+                if (nb_workers < 1 || nb_workers > 256) {
+                    fprintf(stderr,
+                                "%s: wrong worker count passed using -j flag\n",
+                                argv[0]);
+                    exit_with_usage_msg(argv[0]);
+                }
+                break;
+            case 'g':
+            case 'u':
+                golden_filename = parameter;
+                golden_update = option == 'u';
+                break;
             default:
                 fprintf(stderr, "%s: Invalid option %s\n", argv[0], arg);
                 exit_with_usage_msg(argv[0]);
@@ -306,11 +1265,83 @@ int main (int argc, char **argv)
         }
     }
 
-    /* if thread_mode was passed, verify its value */
-    if (thread_mode != NULL) {
-        if (strcmp(thread_mode, frame_threads) && strcmp(thread_mode, slice_threads)) {
+    /* verify the values of the options taking one of a few names */
+    if (thread_mode != NULL)
+        parse_choice(argv[0], thread_mode, 't', "thread mode", thread_modes);
+    if (mode != NULL)
+        parse_choice(argv[0], mode, 'M', "mode", modes);
+    if (objective != NULL)
+        parse_choice(argv[0], objective, 'O', "objective", objectives);
+    if (archive != NULL)
+        parse_choice(argv[0], archive, 'a', "archive type", archives);
+    if (writer_mode != NULL)
+        async_output = parse_choice(argv[0], writer_mode, 'w', "writer", writers) == 1;
+    if (state != NULL)
+        state_mode = parse_choice(argv[0], state, 's', "decoder state", states);
+    if (seed_source != NULL)
+        sched_seed = SEED_INPUT + parse_choice(argv[0], seed_source, 'D', "schedule seed",
+                                               seed_sources);
+    if (allocator != NULL)
+        huge_pages = parse_choice(argv[0], allocator, 'l', "allocator", allocators) == 1;
+
+    if (mode && !strcmp(mode, "encode") && !codec) {
+        fprintf(stderr,
+                    "%s: -M encode needs an encoder passed using -c flag\n",
+                    argv[0]);
+        exit_with_usage_msg(argv[0]);
+    }
+
+    if (mode && (!strcmp(mode, "mux") || !strcmp(mode, "roundtrip")) && !format) {
+        fprintf(stderr,
+                    "%s: -M %s needs a muxer passed using -f flag\n",
+                    argv[0], mode);
+        exit_with_usage_msg(argv[0]);
+    }
+
+    /* workers would share the report, database and profile files */
+    if (mode && !strcmp(mode, "serve") &&
+        (archive || bench_filename || golden_filename || index_filename || profile_prefix)) {
+        fprintf(stderr,
+                    "%s: -M serve cannot be used with -a, -B, -g, -u, -i or -P\n",
+                    argv[0]);
+        exit_with_usage_msg(argv[0]);
+    }
+
+    /* their threads would touch the scheduled decoder's buffers */
+    if (sched_seed != SEED_NONE && (async_output || hash_threads)) {
+        fprintf(stderr,
+                    "%s: -D cannot be used with -w async or -H\n",
+                    argv[0]);
+        exit_with_usage_msg(argv[0]);
+    }
+
+    /* any charset name goes, avcodec_open2() checks it with iconv */
+    if (subtitles != NULL) {
+        if (!strcmp(subtitles, "trailer")) {
+            subtitle_mode = SUBTITLES_TRAILER;
+            /* a kept decoder stays opened with the first input's options */
+            if (state_mode != STATE_RESET) {
+                fprintf(stderr,
+                            "%s: -T trailer cannot be used with -s flush or none\n",
+                            argv[0]);
+                exit_with_usage_msg(argv[0]);
+            }
+        } else {
+            subtitle_mode = SUBTITLES_FIXED;
+            sub_charenc = subtitles;
+        }
+        av_bprint_init(&sub_events, 0, AV_BPRINT_SIZE_UNLIMITED);
+    }
+
+    /* if resampler output was passed, verify its value */
+    if (resample != NULL) {
+        if (!strcmp(resample, "trailer")) {
+            resample_mode = RESAMPLE_TRAILER;
+        } else if (resample_set_output(resample) >= 0) {
+            resample_mode = RESAMPLE_FIXED;
+        } else {
             fprintf(stderr,
-                        "%s: wrong thread mode passed using -t flag\n",
+                        "%s: wrong resampler output passed using -r flag\n",
                         argv[0]);
             exit_with_usage_msg(argv[0]);
         }
@@ -322,141 +1353,100 @@ int main (int argc, char **argv)
     /* register all formats and codecs */
     av_register_all();
 
-#ifdef __AFL_HAVE_MANUAL_CONTROL
-    while (__AFL_LOOP(1000))
-#endif
-    {
-        AVFormatContext *fmt_ctx = NULL;
-        AVInputFormat *fmt       = NULL;
-        AVCodecContext *dec_ctx  = NULL;
-        FILE *dst_file           = NULL;
-        AVFrame *frame           = NULL;
-        int got_frame            = 0;
-        int frame_count          = 0;
-        AVPacket pkt             = { 0 };
-        AVDictionary *opts       = NULL;
-        ret = 0;
-        width = 0;
-        height = 0;
-        pix_fmt = AV_PIX_FMT_NONE;
-        video_dst_bufsize = 0;
-        memset(video_dst_data, 0, sizeof(video_dst_data));
-        memset(video_dst_linesize, 0, sizeof(video_dst_linesize));
-
-        /* set the whitelists for formats and codecs */
-        if (av_dict_set(&opts, "codec_whitelist", codec, 0) < 0) {
-            fprintf(stderr, "Could not set codec_whitelist.\n");
-            ret = 1;
-            goto end;
-        }
-        if (av_dict_set(&opts, "format_whitelist", format, 0) < 0) {
-            fprintf(stderr, "Could not set format_whitelist.\n");
-            ret = 1;
-            goto end;
-        }
-        /* set threading mode */
-        if (av_dict_set(&opts, "thread_type", thread_mode, 0) < 0) {
-            fprintf(stderr, "Could not set thread_type.\n");
-            ret = 1;
-            goto end;
-        }
+    install_crash_handler();
 
-        if (format) {
-            fmt = av_find_input_format(format);
-            if (!fmt) {
-                fprintf(stderr, "Could not find input format %s\n", format);
-                ret = 1;
-                goto end;
-            }
-        }
+    if (sched_seed != SEED_NONE && sched_init() < 0)
+        return 1;
 
-        /* open input file, and allocate format context */
-        if (avformat_open_input(&fmt_ctx, src_filename, fmt, &opts) < 0) {
-            fprintf(stderr, "Could not open source file %s\n", src_filename);
-            ret = 1;
-            goto end;
-        }
+    if (huge_pages && huge_init() < 0)
+        return 1;
 
-        /* retrieve stream information */
-        if (avformat_find_stream_info(fmt_ctx, NULL) < 0) {
-            fprintf(stderr, "Could not find stream information\n");
+    if (mode && !strcmp(mode, "generate")) {
+        char *end;
+        uint64_t seed = strtoull(src_filename, &end, 0);
+        if (!*src_filename || *end) {
+            fprintf(stderr, "%s: the seed of -M generate has to be a number\n", argv[0]);
+            return 1;
         }
+        return generate_corpus(seed, dst_filename);
+    }
 
-        /* find stream with specified codec */
-        if (open_codec_context(&dec_ctx, fmt_ctx, codec) < 0) {
-            fprintf(stderr, "Could not open any stream in input file '%s'\n",
-                    src_filename);
-            ret = 1;
-            goto end;
-        }
+    if (mode && !strcmp(mode, "minimize"))
+        return minimize_input(src_filename, dst_filename, format,
+                              objective && !strcmp(objective, "rss") ? MINIMIZE_RSS : MINIMIZE_CPU);
 
-        /* open output file */
-        dst_file = fopen(dst_filename, "wb");
-        if (!dst_file) {
-            fprintf(stderr, "Could not open destination file %s\n", dst_filename);
-            ret = 1;
-            goto end;
-        }
+    if (mode && !strcmp(mode, "serve"))
+        return serve(src_filename, nb_workers ? nb_workers : sysconf(_SC_NPROCESSORS_ONLN),
+                     dst_filename, decode_job);
 
-        if (dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
-            /* allocate image where the decoded image will be put */
-            width = dec_ctx->width;
-            height = dec_ctx->height;
-            pix_fmt = dec_ctx->pix_fmt;
-            video_dst_bufsize = av_image_alloc(video_dst_data, video_dst_linesize,
-                                 width, height, pix_fmt, 1);
-            if (video_dst_bufsize < 0) {
-                fprintf(stderr, "Could not allocate raw video buffer\n");
-                ret = 1;
-                goto end;
-            }
+    if (profile_prefix && profile_init() < 0)
+        return 1;
+
+    if (bench_filename) {
+        bench_report = fopen(bench_filename, "w");
+        if (!bench_report) {
+            fprintf(stderr, "Could not open benchmark report %s\n", bench_filename);
+            return 1;
         }
+        stage_init();
+    }
 
-        /* dump input information to stderr */
-        av_dump_format(fmt_ctx, 0, src_filename, 0);
+    if (golden_filename && (golden_open(golden_filename, golden_update) < 0 ||
+                            (hash_threads && golden_start_threads(hash_threads) < 0)))
+        return 1;
 
-        /* allocate frame */
-        frame = av_frame_alloc();
-        if (!frame) {
-            fprintf(stderr, "Could not allocate frame\n");
-            ret = 1;
-            goto end;
-        }
+    if (index_filename && func_index_open(index_filename) < 0)
+        return 1;
 
-        printf("Demuxing from file '%s' into '%s'\n", src_filename, dst_filename);
-
-        /* read frames from the file */
-        while (av_read_frame(fmt_ctx, &pkt) >= 0) {
-            do {
-                int decoded = decode_packet(dec_ctx, dst_file, frame, &got_frame, &frame_count, &pkt);
-                if (decoded < 0)
-                    break;
-                /* increase data pointer and decrease size of remaining data buffer */
-                pkt.data += decoded;
-                pkt.size -= decoded;
-            } while (pkt.size > 0);
-            av_free_packet(&pkt);
+    if (archive) {
+        enum archive_type type = !strcmp(archive, "zip") ? ARCHIVE_ZIP :
+                                 !strcmp(archive, "tar") ? ARCHIVE_TAR : ARCHIVE_BATCH;
+        ret = decode_archive(src_filename, type, dst_filename);
+    } else {
+#ifdef __AFL_HAVE_MANUAL_CONTROL
+        while (__AFL_LOOP(1000))
+#endif
+        {
+            if (mode && !strcmp(mode, "encode"))
+                ret = encode_input(src_filename, codec, dst_filename, bench_report);
+            else if (mode && (!strcmp(mode, "mux") || !strcmp(mode, "roundtrip")))
+                ret = mux_input(src_filename, format, !strcmp(mode, "roundtrip"),
+                                dst_filename, bench_report);
+            else if (mode && (!strcmp(mode, "scale") || !strcmp(mode, "scalebench")))
+                ret = scale_input(src_filename, !strcmp(mode, "scalebench"),
+                                  dst_filename, bench_report);
+            else
+                ret = decode_input(src_filename, dst_filename);
         }
+    }
 
-        printf("Flushing cached frames.\n");
-        pkt.data = NULL;
-        pkt.size = 0;
-        do {
-            decode_packet(dec_ctx, dst_file, frame, &got_frame, &frame_count, &pkt);
-        } while (got_frame);
-
-        printf("Demuxing done.\n");
+    if (profile_prefix) {
+        char *profile_filename = av_asprintf("%s.%s.prof", profile_prefix,
+                                             codec ? codec : "all");
+        if (!profile_filename || profile_write(profile_filename) < 0)
+            ret = 1;
+        av_free(profile_filename);
+    }
 
-end:
-        /* free allocated memory */
-        av_dict_free(&opts);
-        avcodec_close(dec_ctx);
-        avformat_close_input(&fmt_ctx);
-        if (dst_file)
-            fclose(dst_file);
-        av_frame_free(&frame);
-        av_free(video_dst_data[0]);
+    if (bench_report) {
+        stage_report_run(bench_report);
+        if (huge_pages)
+            huge_report(bench_report);
+        fclose(bench_report);
     }
 
+    if (golden_filename && golden_close())
+        ret = 1;
+
+    if (index_filename)
+        func_index_close();
+
+    avcodec_free_context(&kept_dec_ctx);
+    encode_close();
+    scale_close();
+    resample_close();
+    if (subtitle_mode != SUBTITLES_RAW)
+        av_bprint_finalize(&sub_events, NULL);
+
     return ret;
 }
@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Minimizer for slow or memory hungry inputs.
+ *
+ * afl-tmin only keeps a cut while the input still crashes. Here a cut is kept
+ * while decoding the smaller input still costs most of the CPU time (or peak
+ * memory) of the original. The input is cut at the packet boundaries the
+ * demuxer reports through pkt.pos and pkt.size, and every batch of candidates
+ * is decoded in parallel forked children, one per core.
+ *
+ * A forked child starts out with the minimizer's resident pages, the input
+ * and the chunk list among them. For the RSS objective every child sends its
+ * RSS right after the fork through a pipe, and only the peak above that
+ * counts, so the cost does not shrink with the minimizer's own buffers.
+ */
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <libavutil/avstring.h>
+#include <libavformat/avformat.h>
+
+#include "fffuzz.h"
+
+/* a cut is kept while the candidate costs at least this share of the original */
+#define KEEP_RATIO 0.9
+#define MAX_JOBS   64
+
+struct chunk {
+    int64_t start;
+    int64_t end;
+};
+
+struct candidate {
+    int first;      ///< first chunk left out
+    int count;      ///< number of chunks left out
+    char *filename;
+    pid_t pid;
+    int rss_fd;     ///< read end of the pipe the child's starting RSS comes through
+    int64_t cost;   ///< -1 if the candidate crashed or could not run
+};
+
+static uint8_t *input;
+static int64_t input_size;
+
+static int read_input(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    long size;
+
+    if (!f) {
+        fprintf(stderr, "Could not open source file %s\n", filename);
+        return -1;
+    }
+    if (fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) < 0) {
+        fprintf(stderr, "Could not get size of %s\n", filename);
+        fclose(f);
+        return -1;
+    }
+    input_size = size;
+    input = av_malloc(FFMAX(input_size, 1));
+    if (!input || fread(input, 1, input_size, f) != (size_t)input_size) {
+        fprintf(stderr, "Could not read source file %s\n", filename);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int add_bound(int64_t **bounds, int *nb_bounds, int *max_bounds, int64_t bound)
+{
+    if (*nb_bounds == *max_bounds) {
+        int64_t *tmp;
+        *max_bounds = FFMAX(2 * *max_bounds, 64);
+        tmp = av_realloc(*bounds, *max_bounds * sizeof(**bounds));
+        if (!tmp)
+            return -1;
+        *bounds = tmp;
+    }
+    (*bounds)[(*nb_bounds)++] = FFMIN(FFMAX(bound, 0), input_size);
+    return 0;
+}
+
+/* split the input at every packet start and end the demuxer reports */
+static int collect_chunks(const char *src_filename, const char *format,
+                          struct chunk **chunks, int *nb_chunks)
+{
+    AVFormatContext *fmt_ctx = NULL;
+    AVInputFormat *fmt       = NULL;
+    AVPacket pkt             = { 0 };
+    int64_t *bounds          = NULL;
+    int nb_bounds = 0, max_bounds = 0, i, n;
+    int ret = -1;
+
+    if (format && !(fmt = av_find_input_format(format))) {
+        fprintf(stderr, "Could not find input format %s\n", format);
+        return -1;
+    }
+    if (avformat_open_input(&fmt_ctx, src_filename, fmt, NULL) < 0) {
+        fprintf(stderr, "Could not open source file %s\n", src_filename);
+        return -1;
+    }
+
+    if (add_bound(&bounds, &nb_bounds, &max_bounds, 0) < 0 ||
+        add_bound(&bounds, &nb_bounds, &max_bounds, input_size) < 0)
+        goto end;
+    while (av_read_frame(fmt_ctx, &pkt) >= 0) {
+        if (pkt.pos >= 0 &&
+            (add_bound(&bounds, &nb_bounds, &max_bounds, pkt.pos) < 0 ||
+             add_bound(&bounds, &nb_bounds, &max_bounds, pkt.pos + pkt.size) < 0)) {
+            av_free_packet(&pkt);
+            goto end;
+        }
+        av_free_packet(&pkt);
+    }
+
+    qsort(bounds, nb_bounds, sizeof(*bounds), cmp_int64);
+    *chunks = av_malloc(nb_bounds * sizeof(**chunks));
+    if (!*chunks)
+        goto end;
+    for (i = 1, n = 0; i < nb_bounds; i++) {
+        if (bounds[i] == bounds[i - 1])
+            continue;
+        (*chunks)[n].start = bounds[i - 1];
+        (*chunks)[n].end   = bounds[i];
+        n++;
+    }
+    *nb_chunks = n;
+    ret = 0;
+
+end:
+    av_free(bounds);
+    avformat_close_input(&fmt_ctx);
+    return ret;
+}
+
+static int write_chunks(const char *filename, const struct chunk *chunks, int nb_chunks,
+                        int skip_first, int skip_count)
+{
+    FILE *f = fopen(filename, "wb");
+    int i, ret = 0;
+
+    if (!f) {
+        fprintf(stderr, "Could not open destination file %s\n", filename);
+        return -1;
+    }
+    for (i = 0; i < nb_chunks; i++) {
+        size_t size = chunks[i].end - chunks[i].start;
+        if (i >= skip_first && i < skip_first + skip_count)
+            continue;
+        if (fwrite(input + chunks[i].start, 1, size, f) != size)
+            ret = -1;
+    }
+    if (fclose(f) || ret < 0) {
+        fprintf(stderr, "Could not write %s\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+/* resident set of the calling process in KiB, as ru_maxrss counts it */
+static int64_t current_rss_kib(void)
+{
+    char buf[64] = { 0 };
+    long long size, resident;
+    int fd = open("/proc/self/statm", O_RDONLY);
+
+    if (fd < 0)
+        return 0;
+    if (read(fd, buf, sizeof(buf) - 1) <= 0 || sscanf(buf, "%lld %lld", &size, &resident) != 2)
+        resident = 0;
+    close(fd);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void spawn_decode(struct candidate *c, const char *filename, int64_t cpu_limit_ms)
+{
+    int rss_pipe[2];
+
+    c->pid    = -1;
+    c->rss_fd = -1;
+    if (pipe(rss_pipe) < 0)
+        return;
+    fflush(stdout);
+    fflush(stderr);
+    c->pid = fork();
+    if (c->pid == 0) {
+        int64_t start_rss = current_rss_kib();
+        int devnull = open("/dev/null", O_WRONLY);
+
+        if (write(rss_pipe[1], &start_rss, sizeof(start_rss)) != sizeof(start_rss))
+            _exit(1);
+        close(rss_pipe[0]);
+        close(rss_pipe[1]);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        if (cpu_limit_ms > 0) {
+            /* a candidate which runs into the limit is slow enough already */
+            struct rlimit rl;
+            rl.rlim_cur = (cpu_limit_ms + 999) / 1000;
+            rl.rlim_max = rl.rlim_cur + 1;
+            setrlimit(RLIMIT_CPU, &rl);
+        }
+        _exit(decode_input(filename, "/dev/null"));
+    }
+    close(rss_pipe[1]);
+    if (c->pid < 0)
+        close(rss_pipe[0]);
+    else
+        c->rss_fd = rss_pipe[0];
+}
+
+static int64_t rusage_cpu_ms(const struct rusage *ru)
+{
+    return (ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000LL +
+           (ru->ru_utime.tv_usec + ru->ru_stime.tv_usec) / 1000;
+}
+
+/**
+ * Wait for the decode of c and return its cost, -1 if it crashed, with its
+ * CPU time in *cpu_ms.
+ */
+static int64_t wait_decode(struct candidate *c, enum minimize_objective objective,
+                           int64_t cpu_limit_ms, int64_t *cpu_ms)
+{
+    struct rusage ru;
+    int64_t start_rss = 0;
+    int status, ok;
+
+    ok = c->pid >= 0 && wait4(c->pid, &status, 0, &ru) == c->pid;
+    if (c->rss_fd >= 0) {
+        if (read(c->rss_fd, &start_rss, sizeof(start_rss)) != sizeof(start_rss))
+            ok = 0;
+        close(c->rss_fd);
+        c->rss_fd = -1;
+    }
+    if (!ok)
+        return -1;
+
+    *cpu_ms = rusage_cpu_ms(&ru);
+    if (WIFSIGNALED(status)) {
+        if (WTERMSIG(status) != SIGXCPU)
+            return -1;
+        if (objective == MINIMIZE_CPU)
+            return FFMAX(*cpu_ms, cpu_limit_ms);
+    }
+    if (objective == MINIMIZE_RSS)
+        return FFMAX(ru.ru_maxrss - start_rss, 0);
+    return *cpu_ms;
+}
+
+int minimize_input(const char *src_filename, const char *dst_filename,
+                   const char *format, enum minimize_objective objective)
+{
+    struct candidate cand[MAX_JOBS] = { { 0 } };
+    struct chunk *chunks = NULL;
+    const char *unit = objective == MINIMIZE_RSS ? "KiB" : "ms";
+    int nb_chunks = 0, jobs, count, removed, i, j;
+    int64_t baseline = -1, baseline_cpu = -1, target, cpu_limit_ms, size;
+    int ret = 1;
+
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = FFMIN(FFMAX(jobs, 1), MAX_JOBS);
+    for (j = 0; j < jobs; j++) {
+        cand[j].filename = av_asprintf("%s.min%d", dst_filename, j);
+        if (!cand[j].filename)
+            goto end;
+    }
+
+    if (read_input(src_filename) < 0)
+        goto end;
+    if (collect_chunks(src_filename, format, &chunks, &nb_chunks) < 0)
+        goto end;
+
+    /* take the cheapest of a few runs of the original as the baseline */
+    for (j = 0; j < FFMIN(jobs, 3); j++)
+        spawn_decode(&cand[j], src_filename, 0);
+    for (j = 0; j < FFMIN(jobs, 3); j++) {
+        int64_t cpu_ms, cost = wait_decode(&cand[j], objective, 0, &cpu_ms);
+        if (cost < 0)
+            continue;
+        if (baseline < 0 || cost < baseline)
+            baseline = cost;
+        if (baseline_cpu < 0 || cpu_ms < baseline_cpu)
+            baseline_cpu = cpu_ms;
+    }
+    if (baseline <= 0) {
+        fprintf(stderr, "Original input %s crashed or costs nothing to decode\n", src_filename);
+        goto end;
+    }
+    target = baseline * KEEP_RATIO;
+    /* with an RSS objective only stop candidates that run away in time */
+    cpu_limit_ms = objective == MINIMIZE_CPU ? target : 4 * baseline_cpu + 1000;
+    fprintf(stderr, "Minimizing %s: %"PRId64" bytes, %d chunks, baseline %"PRId64" %s, %d jobs\n",
+            src_filename, input_size, nb_chunks, baseline, unit, jobs);
+
+    do {
+        removed = 0;
+        for (count = FFMAX(nb_chunks / 2, 1); count > 0; count /= 2) {
+            int first = 0;
+            while (first < nb_chunks && nb_chunks > 1) {
+                int nb_cand = 0, kept = -1;
+
+                for (j = 0; j < jobs && first + j * count < nb_chunks; j++) {
+                    cand[j].first = first + j * count;
+                    cand[j].count = FFMIN(count, nb_chunks - cand[j].first);
+                    cand[j].pid   = -1;
+                    cand[j].rss_fd = -1;
+                    if (write_chunks(cand[j].filename, chunks, nb_chunks,
+                                     cand[j].first, cand[j].count) == 0)
+                        spawn_decode(&cand[j], cand[j].filename, cpu_limit_ms);
+                    nb_cand++;
+                }
+                for (j = 0; j < nb_cand; j++) {
+                    int64_t cpu_ms;
+                    cand[j].cost = wait_decode(&cand[j], objective, cpu_limit_ms, &cpu_ms);
+                    if (kept < 0 && cand[j].cost >= target)
+                        kept = j;
+                }
+
+                if (kept < 0) {
+                    first += nb_cand * count;
+                    continue;
+                }
+                memmove(chunks + cand[kept].first, chunks + cand[kept].first + cand[kept].count,
+                        (nb_chunks - cand[kept].first - cand[kept].count) * sizeof(*chunks));
+                nb_chunks -= cand[kept].count;
+                removed += cand[kept].count;
+                /* the next candidate starts where the removed chunks were */
+                first = cand[kept].first;
+                for (i = 0, size = 0; i < nb_chunks; i++)
+                    size += chunks[i].end - chunks[i].start;
+                fprintf(stderr, "Removed %d chunks: %"PRId64" bytes, %d chunks, %"PRId64" %s\n",
+                        cand[kept].count, size, nb_chunks, cand[kept].cost, unit);
+            }
+        }
+    } while (removed);
+
+    if (write_chunks(dst_filename, chunks, nb_chunks, 0, 0) < 0)
+        goto end;
+    for (i = 0, size = 0; i < nb_chunks; i++)
+        size += chunks[i].end - chunks[i].start;
+    printf("Minimized '%s' into '%s': %"PRId64" -> %"PRId64" bytes\n",
+           src_filename, dst_filename, input_size, size);
+    ret = 0;
+
+end:
+    for (j = 0; j < jobs; j++) {
+        if (cand[j].filename)
+            unlink(cand[j].filename);
+        av_free(cand[j].filename);
+    }
+    av_free(chunks);
+    av_freep(&input);
+    return ret;
+}
@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Muxer fuzzing from stream parameters and packets in the input
+ * (-M mux|roundtrip -f muxer).
+ *
+ * The input is read as:
+ *
+ *   streams - 1, modulo MUX_MAX_STREAMS
+ *   per stream: codec (index into mux_codecs), width or sample rate (LE16),
+ *       height or channels (LE16), time base (index into time_bases),
+ *       extradata length and extradata
+ *   per packet: stream, flags (MUX_FLAG_*), pts delta (LE32, signed),
+ *       pts - dts (LE16, signed), duration (LE16), size (LE16), then with
+ *       MUX_FLAG_SIDE_DATA a side data type, length (LE16) and data, and
+ *       the payload
+ *
+ * until the input ends. The muxer writes into a dynamic buffer, which is
+ * written to output_file at the end. roundtrip also demuxes the buffer
+ * again with the demuxer of the same name, or whichever demuxer probes it
+ * when there is none.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavutil/channel_layout.h>
+#include <libavutil/file.h>
+#include <libavutil/intreadwrite.h>
+#include <libavutil/time.h>
+#include <libavformat/avformat.h>
+
+#include "fffuzz.h"
+
+#define MUX_MAX_STREAMS 4
+
+#define MUX_FLAG_KEY        0x01
+#define MUX_FLAG_SIDE_DATA  0x02
+#define MUX_FLAG_NO_PTS     0x04
+#define MUX_FLAG_NO_DTS     0x08
+
+static const enum AVCodecID mux_codecs[] = {
+    AV_CODEC_ID_H264, AV_CODEC_ID_HEVC, AV_CODEC_ID_MPEG4, AV_CODEC_ID_MPEG2VIDEO,
+    AV_CODEC_ID_VP8, AV_CODEC_ID_VP9, AV_CODEC_ID_MJPEG, AV_CODEC_ID_RAWVIDEO,
+    AV_CODEC_ID_AAC, AV_CODEC_ID_MP3, AV_CODEC_ID_AC3, AV_CODEC_ID_OPUS,
+    AV_CODEC_ID_VORBIS, AV_CODEC_ID_FLAC, AV_CODEC_ID_PCM_S16LE,
+    AV_CODEC_ID_SUBRIP, AV_CODEC_ID_ASS, AV_CODEC_ID_MOV_TEXT, AV_CODEC_ID_DVD_SUBTITLE,
+};
+
+static const enum AVPacketSideDataType side_data_types[] = {
+    AV_PKT_DATA_PALETTE, AV_PKT_DATA_NEW_EXTRADATA, AV_PKT_DATA_PARAM_CHANGE,
+    AV_PKT_DATA_H263_MB_INFO, AV_PKT_DATA_REPLAYGAIN, AV_PKT_DATA_DISPLAYMATRIX,
+    AV_PKT_DATA_STEREO3D, AV_PKT_DATA_AUDIO_SERVICE_TYPE, AV_PKT_DATA_SKIP_SAMPLES,
+    AV_PKT_DATA_JP_DUALMONO, AV_PKT_DATA_STRINGS_METADATA, AV_PKT_DATA_SUBTITLE_POSITION,
+    AV_PKT_DATA_MATROSKA_BLOCKADDITIONAL, AV_PKT_DATA_WEBVTT_IDENTIFIER,
+    AV_PKT_DATA_WEBVTT_SETTINGS, AV_PKT_DATA_METADATA_UPDATE,
+};
+
+static const AVRational time_bases[] = {
+    { 1, 1000 }, { 1, 90000 }, { 1, 25 }, { 1, 48000 }, { 1001, 30000 }, { 1, 1 },
+};
+
+/* the input, read as far as it goes and as zeros after that */
+struct reader {
+    const uint8_t *p, *end;
+};
+
+static unsigned read_u8(struct reader *r)
+{
+    return r->p < r->end ? *r->p++ : 0;
+}
+
+static unsigned read_le16(struct reader *r)
+{
+    unsigned v = read_u8(r);
+    return v | read_u8(r) << 8;
+}
+
+static uint32_t read_le32(struct reader *r)
+{
+    uint32_t v = read_le16(r);
+    return v | (uint32_t)read_le16(r) << 16;
+}
+
+/* up to size bytes, as many as are left */
+static const uint8_t *read_bytes(struct reader *r, unsigned *size)
+{
+    const uint8_t *p = r->p;
+
+    *size = FFMIN(*size, (unsigned)(r->end - r->p));
+    r->p += *size;
+    return p;
+}
+
+static int add_stream(AVFormatContext *oc, struct reader *r)
+{
+    AVStream *st = avformat_new_stream(oc, NULL);
+    AVCodecContext *c;
+    const uint8_t *extradata;
+    unsigned size;
+
+    if (!st)
+        return AVERROR(ENOMEM);
+    c = st->codec;
+    c->codec_id   = mux_codecs[read_u8(r) % FF_ARRAY_ELEMS(mux_codecs)];
+    c->codec_type = avcodec_get_type(c->codec_id);
+    if (c->codec_type == AVMEDIA_TYPE_VIDEO) {
+        c->width   = read_le16(r);
+        c->height  = read_le16(r);
+        c->pix_fmt = AV_PIX_FMT_YUV420P;
+    } else {
+        c->sample_rate    = read_le16(r);
+        c->channels       = read_le16(r);
+        c->channel_layout = av_get_default_channel_layout(c->channels);
+    }
+    st->time_base = c->time_base = time_bases[read_u8(r) % FF_ARRAY_ELEMS(time_bases)];
+
+    size = read_u8(r);
+    extradata = read_bytes(r, &size);
+    if (size) {
+        c->extradata = av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!c->extradata)
+            return AVERROR(ENOMEM);
+        memcpy(c->extradata, extradata, size);
+        c->extradata_size = size;
+    }
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+        c->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    return 0;
+}
+
+/* the next packet of the input, 0 at its end */
+static int read_packet(struct reader *r, AVPacket *pkt, int nb_streams, int64_t *last_pts)
+{
+    enum AVPacketSideDataType type = AV_PKT_DATA_PALETTE;
+    const uint8_t *data, *side_data = NULL;
+    unsigned size, side_size = 0;
+    int stream, flags, dts_offset, duration, ret;
+    int32_t pts_delta;
+
+    if (r->p >= r->end)
+        return 0;
+    stream     = read_u8(r) % nb_streams;
+    flags      = read_u8(r);
+    pts_delta  = (int32_t)read_le32(r);
+    dts_offset = (int16_t)read_le16(r);
+    duration   = read_le16(r);
+    size       = read_le16(r);
+    if (flags & MUX_FLAG_SIDE_DATA) {
+        type = side_data_types[read_u8(r) % FF_ARRAY_ELEMS(side_data_types)];
+        side_size = read_le16(r);
+        side_data = read_bytes(r, &side_size);
+    }
+    data = read_bytes(r, &size);
+
+    /* av_new_packet() resets the side data, so it comes first */
+    if ((ret = av_new_packet(pkt, size)) < 0)
+        return ret;
+    memcpy(pkt->data, data, size);
+    if (side_data) {
+        uint8_t *dst = av_packet_new_side_data(pkt, type, side_size);
+        if (!dst) {
+            av_packet_unref(pkt);
+            return AVERROR(ENOMEM);
+        }
+        memcpy(dst, side_data, side_size);
+    }
+
+    last_pts[stream] += pts_delta;
+    pkt->stream_index = stream;
+    pkt->duration     = duration;
+    pkt->pts = flags & MUX_FLAG_NO_PTS ? AV_NOPTS_VALUE : last_pts[stream];
+    pkt->dts = flags & MUX_FLAG_NO_DTS ? AV_NOPTS_VALUE : last_pts[stream] - dts_offset;
+    if (flags & MUX_FLAG_KEY)
+        pkt->flags |= AV_PKT_FLAG_KEY;
+    return 1;
+}
+
+/* demux what was muxed, with the demuxer named like the muxer or by probing */
+static int demux_buffer(const char *src_filename, const char *muxer,
+                        const uint8_t *buf, int size)
+{
+    AVInputFormat *ifmt = av_find_input_format(muxer);
+    struct memory_input mem = { buf, size, 0 };
+    AVFormatContext *fmt_ctx = avformat_alloc_context();
+    uint8_t *avio_buffer = av_malloc(MEMORY_IO_BUFFER_SIZE);
+    AVIOContext *avio_ctx = NULL;
+    AVPacket pkt;
+    int nb_packets = 0;
+
+    if (avio_buffer)
+        avio_ctx = avio_alloc_context(avio_buffer, MEMORY_IO_BUFFER_SIZE, 0, &mem,
+                                      memory_read, NULL, memory_seek);
+    if (!avio_ctx)
+        av_free(avio_buffer);
+    if (!avio_ctx || !fmt_ctx) {
+        avformat_free_context(fmt_ctx);
+        goto end;
+    }
+    fmt_ctx->pb = avio_ctx;
+    fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    if (avformat_open_input(&fmt_ctx, src_filename, ifmt, NULL) < 0) {
+        fprintf(stderr, "Could not demux the muxed %s\n", src_filename);
+        nb_packets = -1;
+        goto end;
+    }
+    while (av_read_frame(fmt_ctx, &pkt) >= 0) {
+        nb_packets++;
+        av_packet_unref(&pkt);
+    }
+    printf("Demuxed %d packets with %s\n", nb_packets, fmt_ctx->iformat->name);
+    avformat_close_input(&fmt_ctx);
+
+end:
+    if (avio_ctx) {
+        av_freep(&avio_ctx->buffer);
+        av_freep(&avio_ctx);
+    }
+    return nb_packets;
+}
+
+int mux_input(const char *src_filename, const char *muxer, int roundtrip,
+              const char *dst_filename, FILE *report)
+{
+    AVOutputFormat *ofmt = av_guess_format(muxer, NULL, NULL);
+    AVFormatContext *oc = NULL;
+    int64_t last_pts[MUX_MAX_STREAMS] = { 0 };
+    int64_t start, elapsed;
+    uint8_t *data = NULL, *buf = NULL;
+    size_t size = 0;
+    struct reader r;
+    AVPacket pkt;
+    FILE *dst_file;
+    int nb_streams, nb_packets = 0, nb_failed = 0, buf_size = 0, i, ret = 1;
+
+    if (!ofmt || ofmt->flags & AVFMT_NOFILE) {
+        fprintf(stderr, "Could not find muxer %s writing a file\n", muxer ? muxer : "(none)");
+        return 1;
+    }
+    if (av_file_map(src_filename, &data, &size, 0, NULL) < 0) {
+        fprintf(stderr, "Could not read source file %s\n", src_filename);
+        return 1;
+    }
+    r.p   = data;
+    r.end = data + size;
+
+    if (avformat_alloc_output_context2(&oc, ofmt, NULL, NULL) < 0) {
+        fprintf(stderr, "Could not allocate muxer %s\n", muxer);
+        goto end;
+    }
+    oc->flags |= AVFMT_FLAG_BITEXACT;
+    nb_streams = 1 + read_u8(&r) % MUX_MAX_STREAMS;
+    for (i = 0; i < nb_streams; i++) {
+        if (add_stream(oc, &r) < 0) {
+            fprintf(stderr, "Could not add stream\n");
+            goto end;
+        }
+    }
+    if (avio_open_dyn_buf(&oc->pb) < 0) {
+        fprintf(stderr, "Could not allocate output buffer\n");
+        goto end;
+    }
+
+    start = av_gettime_relative();
+    if (avformat_write_header(oc, NULL) < 0) {
+        fprintf(stderr, "Could not write header with %s\n", muxer);
+        goto end;
+    }
+    while ((ret = read_packet(&r, &pkt, nb_streams, last_pts)) > 0) {
+        /* bad timestamps and parameters are refused, go on with the next */
+        if (av_interleaved_write_frame(oc, &pkt) < 0)
+            nb_failed++;
+        else
+            nb_packets++;
+        av_packet_unref(&pkt);
+    }
+    if (ret < 0 || av_write_trailer(oc) < 0)
+        fprintf(stderr, "Could not write trailer with %s\n", muxer);
+    elapsed = FFMAX(av_gettime_relative() - start, 1);
+    ret = 1;
+
+    buf_size = avio_close_dyn_buf(oc->pb, &buf);
+    oc->pb = NULL;
+    printf("Muxed %d packets (%d refused) into %d bytes in %"PRId64" us, %.0f packets/s\n",
+           nb_packets, nb_failed, buf_size, elapsed, nb_packets * 1e6 / elapsed);
+    if (report)
+        fprintf(report, "mux:%s muxer:%s packets:%d refused:%d bytes:%d us:%"PRId64
+                " packets_per_s:%.0f\n", src_filename, ofmt->name, nb_packets, nb_failed,
+                buf_size, elapsed, nb_packets * 1e6 / elapsed);
+
+    dst_file = fopen(dst_filename, "wb");
+    if (!dst_file) {
+        fprintf(stderr, "Could not open destination file %s\n", dst_filename);
+        goto end;
+    }
+    fwrite(buf, 1, buf_size, dst_file);
+    fclose(dst_file);
+
+    if (roundtrip && buf_size > 0)
+        demux_buffer(src_filename, muxer, buf, buf_size);
+    ret = 0;
+
+end:
+    if (oc && oc->pb) {
+        uint8_t *unused;
+        avio_close_dyn_buf(oc->pb, &unused);
+        av_free(unused);
+    }
+    avformat_free_context(oc);
+    av_free(buf);
+    av_file_unmap(data, size);
+    return ret;
+}
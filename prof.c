@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * SIGPROF sampling profiler for the demux/decode loop.
+ *
+ * Every PROFILE_INTERVAL_US of CPU time the interrupted PC is counted in a
+ * lock-free table which lives for the whole process, so samples add up over
+ * persistent iterations. The flat profile is symbolised with dladdr() only
+ * when it is written, which needs the harness linked with -rdynamic.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <sys/time.h>
+
+#include "fffuzz.h"
+
+#define PROFILE_INTERVAL_US 1000
+#define PROFILE_TABLE_BITS  16
+#define PROFILE_TABLE_SIZE  (1 << PROFILE_TABLE_BITS)
+
+struct pc_count {
+    uintptr_t pc;
+    uint64_t  count;
+};
+
+struct symbol_count {
+    const char *name;
+    const char *object;
+    uintptr_t   addr;
+    uint64_t    count;
+};
+
+static struct pc_count table[PROFILE_TABLE_SIZE];
+static uint64_t nb_samples, nb_dropped;
+
+static uintptr_t context_pc(void *context)
+{
+    ucontext_t *uc = context;
+#if defined(__x86_64__)
+    return uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+    return uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+    return uc->uc_mcontext.pc;
+#else
+    (void)uc;
+    return 0;
+#endif
+}
+
+static void profile_handler(int sig, siginfo_t *info, void *context)
+{
+    uintptr_t pc = context_pc(context);
+    unsigned i, slot = (pc * 0x9E3779B97F4A7C15ULL) >> (64 - PROFILE_TABLE_BITS);
+
+    /* open addressing; samples can arrive on several decoder threads at once */
+    for (i = 0; i < PROFILE_TABLE_SIZE; i++, slot = (slot + 1) & (PROFILE_TABLE_SIZE - 1)) {
+        uintptr_t expected = 0;
+        if (__atomic_load_n(&table[slot].pc, __ATOMIC_RELAXED) == pc ||
+            __atomic_compare_exchange_n(&table[slot].pc, &expected, pc, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED) ||
+            expected == pc) {
+            __atomic_fetch_add(&table[slot].count, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&nb_samples, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    __atomic_fetch_add(&nb_dropped, 1, __ATOMIC_RELAXED);
+}
+
+int profile_init(void)
+{
+    struct sigaction action = { 0 };
+
+    action.sa_sigaction = profile_handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, NULL) < 0) {
+        fprintf(stderr, "Could not install the SIGPROF handler\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void set_timer(long interval_us)
+{
+    struct itimerval timer = { { 0, interval_us }, { 0, interval_us } };
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+void profile_start(void)
+{
+    set_timer(PROFILE_INTERVAL_US);
+}
+
+void profile_stop(void)
+{
+    set_timer(0);
+}
+
+static int cmp_symbol_addr(const void *a, const void *b)
+{
+    const struct symbol_count *x = a, *y = b;
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+static int cmp_symbol_count(const void *a, const void *b)
+{
+    const struct symbol_count *x = a, *y = b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+int profile_write(const char *filename)
+{
+    struct symbol_count *symbols;
+    FILE *f;
+    int i, n = 0, nb_symbols = 0;
+
+    symbols = calloc(PROFILE_TABLE_SIZE, sizeof(*symbols));
+    if (!symbols) {
+        fprintf(stderr, "Could not allocate the profile\n");
+        return -1;
+    }
+
+    /* fold the PCs into the functions containing them */
+    for (i = 0; i < PROFILE_TABLE_SIZE; i++) {
+        Dl_info info = { 0 };
+        if (!table[i].count)
+            continue;
+        if (dladdr((void *)table[i].pc, &info) && info.dli_saddr) {
+            symbols[n].name   = info.dli_sname;
+            symbols[n].addr   = (uintptr_t)info.dli_saddr;
+        } else {
+            symbols[n].name   = NULL;
+            symbols[n].addr   = table[i].pc;
+        }
+        symbols[n].object = info.dli_fname;
+        symbols[n].count  = table[i].count;
+        n++;
+    }
+    qsort(symbols, n, sizeof(*symbols), cmp_symbol_addr);
+    for (i = 0; i < n; i++) {
+        if (nb_symbols && symbols[i].name &&
+            symbols[nb_symbols - 1].addr == symbols[i].addr) {
+            symbols[nb_symbols - 1].count += symbols[i].count;
+            continue;
+        }
+        symbols[nb_symbols++] = symbols[i];
+    }
+    qsort(symbols, nb_symbols, sizeof(*symbols), cmp_symbol_count);
+
+    f = fopen(filename, "w");
+    if (!f) {
+        fprintf(stderr, "Could not open profile file %s\n", filename);
+        free(symbols);
+        return -1;
+    }
+    fprintf(f, "# %"PRIu64" samples every %d us of CPU time, %"PRIu64" dropped\n",
+            nb_samples, PROFILE_INTERVAL_US, nb_dropped);
+    for (i = 0; i < nb_symbols; i++) {
+        const char *object = symbols[i].object ? strrchr(symbols[i].object, '/') : NULL;
+        object = object ? object + 1 : symbols[i].object ? symbols[i].object : "?";
+        if (symbols[i].name)
+            fprintf(f, "%6.2f%% %10"PRIu64" %s (%s)\n",
+                    100.0 * symbols[i].count / nb_samples, symbols[i].count,
+                    symbols[i].name, object);
+        else
+            fprintf(f, "%6.2f%% %10"PRIu64" 0x%"PRIxPTR" (%s)\n",
+                    100.0 * symbols[i].count / nb_samples, symbols[i].count,
+                    symbols[i].addr, object);
+    }
+    fclose(f);
+    free(symbols);
+    return 0;
+}
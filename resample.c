@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * libswresample stage for decoded audio (-r).
+ *
+ * Every decoded audio frame goes through one SwrContext, kept across
+ * inputs and only set up again when the input or output parameters change.
+ * At the end of each input the resampler is drained and initialized again,
+ * which clears its delay line and filter state for the next one. The output
+ * parameters are fixed, or picked per input from RESAMPLE_TRAILER_SIZE
+ * bytes:
+ *
+ *   0  output rate, index into rates
+ *   1  output layout, index into layouts
+ *   2  output sample format
+ *   3  filter size (bits 0-1), linear interpolation (bit 2), dither method
+ *      (bits 3-5) and a short phase shift (bit 6)
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+#include <libavutil/samplefmt.h>
+#include <libavutil/time.h>
+#include <libswresample/swresample.h>
+
+#include "fffuzz.h"
+
+#define RESAMPLE_MAX_CHANNELS 64
+
+static const int rates[] = {
+    8000, 11025, 16000, 22050, 32000, 44100, 48000, 96000,
+    192000, 7350, 12345, 88200,
+};
+
+static const uint64_t layouts[] = {
+    AV_CH_LAYOUT_MONO, AV_CH_LAYOUT_STEREO, AV_CH_LAYOUT_2POINT1, AV_CH_LAYOUT_SURROUND,
+    AV_CH_LAYOUT_QUAD, AV_CH_LAYOUT_5POINT1, AV_CH_LAYOUT_5POINT1_BACK,
+    AV_CH_LAYOUT_6POINT1, AV_CH_LAYOUT_7POINT1,
+};
+
+static const int filter_sizes[] = { 32, 16, 8, 64 };
+
+/* SWR_DITHER_* values, the last four noise shaping */
+static const int dither_methods[] = { 0, 1, 2, 3, 65, 66, 67, 68 };
+
+/* the parameters a cached context was set up with */
+struct resample_params {
+    int                 in_rate, out_rate;
+    uint64_t            in_layout, out_layout;
+    enum AVSampleFormat in_fmt, out_fmt;
+    int                 options;    ///< trailer byte 3
+};
+
+static struct resample_params output = {
+    .out_rate = 48000, .out_layout = AV_CH_LAYOUT_STEREO, .out_fmt = AV_SAMPLE_FMT_S16,
+};
+static struct resample_params current;
+static struct SwrContext *swr_ctx;
+
+static uint8_t *out_data[RESAMPLE_MAX_CHANNELS];
+static int out_capacity, out_channels;
+static enum AVSampleFormat out_format = AV_SAMPLE_FMT_NONE;
+
+/* samples through swr_convert() for the current input */
+static struct {
+    int     nb_frames;
+    int64_t in_samples, out_samples;
+    int64_t us;
+} stats;
+
+int resample_set_output(const char *spec)
+{
+    char layout[64], fmt[32];
+    int rate;
+
+    if (sscanf(spec, "%d:%63[^:]:%31s", &rate, layout, fmt) != 3 || rate <= 0)
+        return AVERROR(EINVAL);
+    output.out_rate   = rate;
+    output.out_layout = av_get_channel_layout(layout);
+    output.out_fmt    = av_get_sample_fmt(fmt);
+    if (!output.out_layout || output.out_fmt == AV_SAMPLE_FMT_NONE)
+        return AVERROR(EINVAL);
+    return 0;
+}
+
+void resample_pick_output(const uint8_t options[RESAMPLE_TRAILER_SIZE])
+{
+    output.out_rate   = rates[options[0] % FF_ARRAY_ELEMS(rates)];
+    output.out_layout = layouts[options[1] % FF_ARRAY_ELEMS(layouts)];
+    output.out_fmt    = options[2] % AV_SAMPLE_FMT_NB;
+    output.options    = options[3];
+}
+
+static int same_params(const struct resample_params *a, const struct resample_params *b)
+{
+    return a->in_rate    == b->in_rate    && a->out_rate   == b->out_rate   &&
+           a->in_layout  == b->in_layout  && a->out_layout == b->out_layout &&
+           a->in_fmt     == b->in_fmt     && a->out_fmt    == b->out_fmt    &&
+           a->options    == b->options;
+}
+
+/* set swr_ctx up for params, unless it already is */
+static int configure(const struct resample_params *params)
+{
+    int ret;
+
+    if (swr_ctx && same_params(params, &current))
+        return 0;
+    swr_ctx = swr_alloc_set_opts(swr_ctx, params->out_layout, params->out_fmt,
+                                 params->out_rate, params->in_layout, params->in_fmt,
+                                 params->in_rate, 0, NULL);
+    if (!swr_ctx)
+        return AVERROR(ENOMEM);
+    av_opt_set_int(swr_ctx, "filter_size", filter_sizes[params->options & 3], 0);
+    av_opt_set_int(swr_ctx, "linear_interp", !!(params->options & 4), 0);
+    av_opt_set_int(swr_ctx, "dither_method", dither_methods[params->options >> 3 & 7], 0);
+    av_opt_set_int(swr_ctx, "phase_shift", params->options & 64 ? 5 : 10, 0);
+    if ((ret = swr_init(swr_ctx)) < 0) {
+        /* set up again for the next frame */
+        swr_free(&swr_ctx);
+        return ret;
+    }
+    current = *params;
+    return 0;
+}
+
+/* make out_data hold nb_samples of the current output */
+static int grow_output(int nb_samples)
+{
+    int channels = av_get_channel_layout_nb_channels(current.out_layout);
+
+    if (nb_samples <= out_capacity && channels == out_channels &&
+        current.out_fmt == out_format)
+        return 0;
+    av_freep(&out_data[0]);
+    out_capacity = 0;
+    if (av_samples_alloc(out_data, NULL, channels, nb_samples, current.out_fmt, 0) < 0)
+        return AVERROR(ENOMEM);
+    out_capacity = nb_samples;
+    out_channels = channels;
+    out_format   = current.out_fmt;
+    return 0;
+}
+
+static void write_samples(FILE *dst_file, int nb_samples)
+{
+    int planar = av_sample_fmt_is_planar(current.out_fmt);
+    int size   = nb_samples * av_get_bytes_per_sample(current.out_fmt);
+    int p;
+
+    if (!dst_file)
+        return;
+    if (!planar)
+        size *= out_channels;
+    for (p = 0; p < (planar ? out_channels : 1); p++)
+        fwrite(out_data[p], 1, size, dst_file);
+}
+
+/* run in (NULL to drain) through swr_ctx and write what comes out */
+static int convert(const uint8_t **in, int nb_in, FILE *dst_file)
+{
+    int64_t start;
+    int nb_out, ret;
+
+    nb_out = av_rescale_rnd(swr_get_delay(swr_ctx, current.in_rate) + nb_in,
+                            current.out_rate, current.in_rate, AV_ROUND_UP);
+    if ((ret = grow_output(FFMAX(nb_out, 1))) < 0)
+        return ret;
+    start = av_gettime_relative();
+    ret = swr_convert(swr_ctx, out_data, out_capacity, in, nb_in);
+    stats.us += av_gettime_relative() - start;
+    if (ret > 0) {
+        stats.out_samples += ret;
+        write_samples(dst_file, ret);
+    }
+    return ret;
+}
+
+int resample_frame(const AVFrame *frame, FILE *dst_file)
+{
+    struct resample_params params = output;
+    int channels = av_frame_get_channels(frame);
+    int ret;
+
+    params.in_rate   = frame->sample_rate;
+    params.in_fmt    = frame->format;
+    params.in_layout = frame->channel_layout;
+    if (av_get_channel_layout_nb_channels(params.in_layout) != channels)
+        params.in_layout = av_get_default_channel_layout(channels);
+    if (params.in_rate <= 0 || !params.in_layout)
+        return AVERROR_INVALIDDATA;
+
+    if ((ret = configure(&params)) < 0) {
+        fprintf(stderr, "Could not set up resampling from %d Hz %d channels %s (%s)\n",
+                params.in_rate, channels, av_get_sample_fmt_name(params.in_fmt),
+                av_err2str(ret));
+        return ret;
+    }
+    ret = convert((const uint8_t **)frame->extended_data, frame->nb_samples, dst_file);
+    if (ret < 0) {
+        fprintf(stderr, "Error resampling audio frame (%s)\n", av_err2str(ret));
+        return ret;
+    }
+    stats.nb_frames++;
+    stats.in_samples += frame->nb_samples;
+    return 0;
+}
+
+void resample_end_input(const char *src_filename, FILE *dst_file, FILE *report)
+{
+    char layout[64];
+    double rate;
+
+    while (swr_ctx && convert(NULL, 0, dst_file) > 0)
+        ;
+    /* a drained context is flushed, not reset */
+    if (swr_ctx && swr_init(swr_ctx) < 0)
+        swr_free(&swr_ctx);
+    if (!stats.nb_frames)
+        goto end;
+
+    av_get_channel_layout_string(layout, sizeof(layout), 0, current.out_layout);
+    rate = stats.in_samples * 1000000.0 / FFMAX(stats.us, 1);
+    printf("Resampled %d frames, %"PRId64" samples to %d Hz %s %s in %"PRId64" us,"
+           " %.0f samples/s\n", stats.nb_frames, stats.in_samples, current.out_rate,
+           layout, av_get_sample_fmt_name(current.out_fmt), stats.us, rate);
+    if (report)
+        fprintf(report, "resample:%s out:%d:%s:%s options:0x%02x frames:%d"
+                " in_samples:%"PRId64" out_samples:%"PRId64" us:%"PRId64
+                " samples_per_s:%.0f\n", src_filename, current.out_rate, layout,
+                av_get_sample_fmt_name(current.out_fmt), current.options,
+                stats.nb_frames, stats.in_samples, stats.out_samples, stats.us, rate);
+end:
+    memset(&stats, 0, sizeof(stats));
+}
+
+void resample_close(void)
+{
+    swr_free(&swr_ctx);
+    av_freep(&out_data[0]);
+    out_capacity = 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * swscale fuzzing and benchmarking (-M scale|scalebench).
+ *
+ * The input starts with a SCALE_HEADER_SIZE byte header:
+ *
+ *   0  source width - 1, LE16 modulo SCALE_MAX_SIZE
+ *   2  source height - 1
+ *   4  destination width - 1
+ *   6  destination height - 1
+ *   8  source format, index into the formats swscale reads
+ *   9  destination format, index into the formats swscale writes
+ *  10  scaler, index into scalers, and flag bits from scaler_flags
+ *  12  source colourspace (index into colorspaces), 0x80 for full range
+ *  13  the same for the destination
+ *  14  brightness, signed
+ *  15  contrast, signed
+ *
+ * and the rest fills the source planes, repeated as needed. The context
+ * comes from sws_getCachedContext(), so inputs with the same conversion
+ * reuse it. scalebench converts the frame for SCALE_BENCH_US at least and
+ * reports megapixels per second (of the destination) for the conversion.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavutil/file.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/intreadwrite.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <libswscale/swscale.h>
+
+#include "fffuzz.h"
+
+#define SCALE_HEADER_SIZE 16
+#define SCALE_MAX_SIZE    4096
+#define SCALE_BENCH_US    500000
+
+static const int scalers[] = {
+    SWS_FAST_BILINEAR, SWS_BILINEAR, SWS_BICUBIC, SWS_X, SWS_POINT, SWS_AREA,
+    SWS_BICUBLIN, SWS_GAUSS, SWS_SINC, SWS_LANCZOS, SWS_SPLINE,
+};
+
+/* picked by bits 4 and up of the scaler field */
+static const int scaler_flags[] = {
+    SWS_FULL_CHR_H_INT, SWS_FULL_CHR_H_INP, SWS_ACCURATE_RND, SWS_BITEXACT,
+    SWS_ERROR_DIFFUSION, SWS_DIRECT_BGR,
+};
+
+static const int colorspaces[] = {
+    SWS_CS_ITU709, SWS_CS_FCC, SWS_CS_ITU601, SWS_CS_SMPTE240M, SWS_CS_BT2020,
+};
+
+static struct SwsContext *sws_ctx;
+static enum AVPixelFormat *input_formats, *output_formats;
+static int nb_input_formats, nb_output_formats;
+
+static int list_formats(void)
+{
+    const AVPixFmtDescriptor *desc = NULL;
+    int nb_formats = 0;
+
+    while ((desc = av_pix_fmt_desc_next(desc)))
+        nb_formats++;
+    input_formats  = av_malloc_array(nb_formats, sizeof(*input_formats));
+    output_formats = av_malloc_array(nb_formats, sizeof(*output_formats));
+    if (!input_formats || !output_formats)
+        return AVERROR(ENOMEM);
+    while ((desc = av_pix_fmt_desc_next(desc))) {
+        enum AVPixelFormat pix_fmt = av_pix_fmt_desc_get_id(desc);
+        if (sws_isSupportedInput(pix_fmt))
+            input_formats[nb_input_formats++] = pix_fmt;
+        if (sws_isSupportedOutput(pix_fmt))
+            output_formats[nb_output_formats++] = pix_fmt;
+    }
+    return 0;
+}
+
+/* the visible bytes of every plane, as rawvideo has them */
+static void write_image(FILE *dst_file, uint8_t *data[4], const int linesize[4],
+                        enum AVPixelFormat pix_fmt, int width, int height)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    int linesizes[4], p, y;
+
+    if (av_image_fill_linesizes(linesizes, pix_fmt, width) < 0)
+        return;
+    for (p = 0; p < 4 && data[p]; p++) {
+        int h = height;
+        if (p == 1 && desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_PSEUDOPAL)) {
+            fwrite(data[1], 1, 256 * 4, dst_file);
+            break;
+        }
+        if (p == 1 || p == 2)
+            h = -((-h) >> desc->log2_chroma_h);
+        for (y = 0; y < h; y++)
+            fwrite(data[p] + y * linesize[p], 1, linesizes[p], dst_file);
+    }
+}
+
+int scale_input(const char *src_filename, int benchmark, const char *dst_filename,
+                FILE *report)
+{
+    uint8_t *data = NULL, *src_data[4] = { NULL }, *dst_data[4] = { NULL };
+    int src_linesize[4], dst_linesize[4];
+    int src_w, src_h, dst_w, dst_h, flags, src_cs, dst_cs, i, size, ret = 1;
+    enum AVPixelFormat src_fmt, dst_fmt;
+    int64_t start, elapsed, nb_pixels = 0;
+    size_t input_size = 0, payload_size, pos;
+    const uint8_t *payload;
+    FILE *dst_file = NULL;
+    int nb_scaled = 0;
+
+    if (!input_formats && list_formats() < 0) {
+        fprintf(stderr, "Could not list pixel formats\n");
+        return 1;
+    }
+    if (av_file_map(src_filename, &data, &input_size, 0, NULL) < 0) {
+        fprintf(stderr, "Could not read source file %s\n", src_filename);
+        return 1;
+    }
+    if (input_size < SCALE_HEADER_SIZE) {
+        fprintf(stderr, "Input %s is shorter than the scale header\n", src_filename);
+        goto end;
+    }
+    payload      = data + SCALE_HEADER_SIZE;
+    payload_size = input_size - SCALE_HEADER_SIZE;
+
+    src_w   = 1 + AV_RL16(data)     % SCALE_MAX_SIZE;
+    src_h   = 1 + AV_RL16(data + 2) % SCALE_MAX_SIZE;
+    dst_w   = 1 + AV_RL16(data + 4) % SCALE_MAX_SIZE;
+    dst_h   = 1 + AV_RL16(data + 6) % SCALE_MAX_SIZE;
+    src_fmt = input_formats[data[8] % nb_input_formats];
+    dst_fmt = output_formats[data[9] % nb_output_formats];
+    flags   = scalers[(AV_RL16(data + 10) & 15) % FF_ARRAY_ELEMS(scalers)];
+    for (i = 0; i < FF_ARRAY_ELEMS(scaler_flags); i++)
+        if (AV_RL16(data + 10) & 16 << i)
+            flags |= scaler_flags[i];
+    src_cs = colorspaces[(data[12] & 0x7f) % FF_ARRAY_ELEMS(colorspaces)];
+    dst_cs = colorspaces[(data[13] & 0x7f) % FF_ARRAY_ELEMS(colorspaces)];
+
+    sws_ctx = sws_getCachedContext(sws_ctx, src_w, src_h, src_fmt, dst_w, dst_h, dst_fmt,
+                                   flags, NULL, NULL, NULL);
+    if (!sws_ctx) {
+        fprintf(stderr, "Could not get a scaler from %dx%d %s to %dx%d %s\n",
+                src_w, src_h, av_get_pix_fmt_name(src_fmt),
+                dst_w, dst_h, av_get_pix_fmt_name(dst_fmt));
+        goto end;
+    }
+    /* fails for RGB on either side, which is fine */
+    sws_setColorspaceDetails(sws_ctx, sws_getCoefficients(src_cs), data[12] >> 7,
+                             sws_getCoefficients(dst_cs), data[13] >> 7,
+                             (int8_t)data[14] * 1024, (1 << 16) + (int8_t)data[15] * 512,
+                             1 << 16);
+
+    size = av_image_alloc(src_data, src_linesize, src_w, src_h, src_fmt, 32);
+    if (size < 0 || av_image_alloc(dst_data, dst_linesize, dst_w, dst_h, dst_fmt, 32) < 0) {
+        fprintf(stderr, "Could not allocate images\n");
+        goto end;
+    }
+    /* the whole source buffer, planes and padding, from the payload */
+    if (!payload_size)
+        memset(src_data[0], 0x80, size);
+    for (pos = 0; payload_size && pos < (size_t)size; pos += payload_size)
+        memcpy(src_data[0] + pos, payload, FFMIN(payload_size, size - pos));
+
+    printf("Scaling %dx%d %s to %dx%d %s with flags 0x%x\n",
+           src_w, src_h, av_get_pix_fmt_name(src_fmt),
+           dst_w, dst_h, av_get_pix_fmt_name(dst_fmt), flags);
+
+    start = av_gettime_relative();
+    do {
+        sws_scale(sws_ctx, (const uint8_t * const *)src_data, src_linesize, 0, src_h,
+                  dst_data, dst_linesize);
+        nb_pixels += (int64_t)dst_w * dst_h;
+        nb_scaled++;
+        elapsed = FFMAX(av_gettime_relative() - start, 1);
+    } while (benchmark && elapsed < SCALE_BENCH_US);
+
+    if (benchmark) {
+        printf("Scaled %d times in %"PRId64" us, %.1f MP/s\n",
+               nb_scaled, elapsed, (double)nb_pixels / elapsed);
+        if (report)
+            fprintf(report, "scale:%s src:%dx%d:%s dst:%dx%d:%s flags:0x%x frames:%d"
+                    " us:%"PRId64" mp_per_s:%.1f\n", src_filename,
+                    src_w, src_h, av_get_pix_fmt_name(src_fmt),
+                    dst_w, dst_h, av_get_pix_fmt_name(dst_fmt), flags,
+                    nb_scaled, elapsed, (double)nb_pixels / elapsed);
+    }
+
+    dst_file = fopen(dst_filename, "wb");
+    if (!dst_file) {
+        fprintf(stderr, "Could not open destination file %s\n", dst_filename);
+        goto end;
+    }
+    write_image(dst_file, dst_data, dst_linesize, dst_fmt, dst_w, dst_h);
+    ret = 0;
+
+end:
+    if (dst_file)
+        fclose(dst_file);
+    av_freep(&src_data[0]);
+    av_freep(&dst_data[0]);
+    av_file_unmap(data, input_size);
+    return ret;
+}
+
+void scale_close(void)
+{
+    sws_freeContext(sws_ctx);
+    sws_ctx = NULL;
+    av_freep(&input_formats);
+    av_freep(&output_formats);
+}
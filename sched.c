@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Deterministic scheduling of the decoder threads.
+ *
+ * Built with -DFFFUZZ_SCHED (./build.sh sched), the harness defines
+ * pthread_create, join and the mutex and condition variable functions
+ * itself, so FFmpeg's frame and slice threads call these. Threads and objects created between
+ * sched_begin() and sched_end() are managed: only one managed thread runs
+ * at a time, and at every call on a managed object the running thread hands
+ * over to a runnable thread picked by a PRNG seeded from the input. Mutexes
+ * and condition variables are emulated on top of that, so the interleaving
+ * only depends on the seed. Everything else goes to the real functions.
+ *
+ * Harness threads (archive reader, async writer, hash helpers) are not
+ * managed and must not touch managed objects, so -D excludes -w async and
+ * -H. A decoder spinning without calling any of these would never give up
+ * its turn; a state where no managed thread can run aborts.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fffuzz.h"
+
+#ifdef FFFUZZ_SCHED
+
+#define SCHED_MAX_THREADS 256
+#define SCHED_MAX_OBJECTS 4096      ///< power of two
+
+enum thread_state {
+    THREAD_FREE,
+    THREAD_RUNNABLE,
+    THREAD_BLOCKED,
+    THREAD_DONE,
+};
+
+struct sched_thread {
+    enum thread_state state;
+    const void *wait_on;    ///< mutex, condition variable or thread blocked on
+    sem_t wake;             ///< posted to hand this thread its turn
+    pthread_t id;
+    void *(*start)(void *);
+    void *arg;
+};
+
+struct sched_object {
+    const void *addr;
+    struct sched_thread *owner;     ///< mutex holder
+};
+
+#define OBJECT_DELETED ((const void *)1)
+
+static int (*real_create)(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *);
+static int (*real_join)(pthread_t, void **);
+static int (*real_mutex_init)(pthread_mutex_t *, const pthread_mutexattr_t *);
+static int (*real_mutex_destroy)(pthread_mutex_t *);
+static int (*real_mutex_lock)(pthread_mutex_t *);
+static int (*real_mutex_trylock)(pthread_mutex_t *);
+static int (*real_mutex_unlock)(pthread_mutex_t *);
+static int (*real_cond_init)(pthread_cond_t *, const pthread_condattr_t *);
+static int (*real_cond_destroy)(pthread_cond_t *);
+static int (*real_cond_wait)(pthread_cond_t *, pthread_mutex_t *);
+static int (*real_cond_timedwait)(pthread_cond_t *, pthread_mutex_t *, const struct timespec *);
+static int (*real_cond_signal)(pthread_cond_t *);
+static int (*real_cond_broadcast)(pthread_cond_t *);
+
+static int enabled;
+static int in_window;
+static uint64_t rng;
+static int nb_threads;      ///< high-water mark of used thread slots
+static struct sched_thread threads[SCHED_MAX_THREADS];
+static struct sched_object objects[SCHED_MAX_OBJECTS];
+static __thread struct sched_thread *self;
+
+/* a constructor, so the symbols are resolved before any decoder thread
+ * exists; the calls in the functions below only cover library constructors
+ * running before this one */
+static void __attribute__((constructor)) resolve(void)
+{
+    if (real_cond_broadcast)
+        return;
+    real_create         = dlsym(RTLD_NEXT, "pthread_create");
+    real_join           = dlsym(RTLD_NEXT, "pthread_join");
+    real_mutex_init     = dlsym(RTLD_NEXT, "pthread_mutex_init");
+    real_mutex_destroy  = dlsym(RTLD_NEXT, "pthread_mutex_destroy");
+    real_mutex_lock     = dlsym(RTLD_NEXT, "pthread_mutex_lock");
+    real_mutex_trylock  = dlsym(RTLD_NEXT, "pthread_mutex_trylock");
+    real_mutex_unlock   = dlsym(RTLD_NEXT, "pthread_mutex_unlock");
+    real_cond_init      = dlsym(RTLD_NEXT, "pthread_cond_init");
+    real_cond_destroy   = dlsym(RTLD_NEXT, "pthread_cond_destroy");
+    real_cond_wait      = dlsym(RTLD_NEXT, "pthread_cond_wait");
+    real_cond_timedwait = dlsym(RTLD_NEXT, "pthread_cond_timedwait");
+    real_cond_signal    = dlsym(RTLD_NEXT, "pthread_cond_signal");
+    real_cond_broadcast = dlsym(RTLD_NEXT, "pthread_cond_broadcast");
+}
+
+/* xorshift64* */
+static unsigned pick(unsigned n)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return (unsigned)((rng * 0x2545F4914F6CDD1DULL) >> 32) % n;
+}
+
+static struct sched_object *find_object(const void *addr, int create)
+{
+    unsigned slot = ((uintptr_t)addr >> 3) * 0x9E3779B1u & (SCHED_MAX_OBJECTS - 1), i;
+    struct sched_object *free_slot = NULL;
+
+    for (i = 0; i < SCHED_MAX_OBJECTS; i++, slot = (slot + 1) & (SCHED_MAX_OBJECTS - 1)) {
+        struct sched_object *obj = &objects[slot];
+        if (obj->addr == addr)
+            return obj;
+        if (obj->addr == OBJECT_DELETED && !free_slot)
+            free_slot = obj;
+        if (!obj->addr) {
+            if (!free_slot)
+                free_slot = obj;
+            break;
+        }
+    }
+    if (!create || !free_slot)
+        return NULL;
+    free_slot->addr  = addr;
+    free_slot->owner = NULL;
+    return free_slot;
+}
+
+/* the object, if the calling thread is managed and the object is (or can
+ * become) managed */
+static struct sched_object *managed(const void *addr)
+{
+    resolve();
+    if (!enabled || !self)
+        return NULL;
+    return find_object(addr, in_window);
+}
+
+static void deadlock(void)
+{
+    static const char msg[] = "fffuzz sched: deadlock, no decoder thread can run\n";
+    write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    abort();
+}
+
+/* hand the turn to a runnable thread picked by the seed, maybe ourselves */
+static void reschedule(struct sched_thread *me)
+{
+    int runnable[SCHED_MAX_THREADS], n = 0, i;
+    struct sched_thread *next;
+
+    for (i = 0; i < nb_threads; i++)
+        if (threads[i].state == THREAD_RUNNABLE)
+            runnable[n++] = i;
+    if (!n) {
+        if (me->state == THREAD_DONE)
+            return;
+        deadlock();
+    }
+    next = &threads[runnable[n > 1 ? pick(n) : 0]];
+    if (next == me)
+        return;
+    sem_post(&next->wake);
+    if (me->state == THREAD_DONE)
+        return;
+    while (sem_wait(&me->wake) < 0 && errno == EINTR)
+        ;
+}
+
+static void block(struct sched_thread *me, const void *on)
+{
+    me->state   = THREAD_BLOCKED;
+    me->wait_on = on;
+    reschedule(me);
+}
+
+/* make the threads blocked on obj runnable, all of them or one picked */
+static void wake(const void *obj, int all)
+{
+    int waiting[SCHED_MAX_THREADS], n = 0, i;
+
+    for (i = 0; i < nb_threads; i++)
+        if (threads[i].state == THREAD_BLOCKED && threads[i].wait_on == obj)
+            waiting[n++] = i;
+    if (!n)
+        return;
+    if (!all) {
+        waiting[0] = waiting[n > 1 ? pick(n) : 0];
+        n = 1;
+    }
+    for (i = 0; i < n; i++) {
+        threads[waiting[i]].state   = THREAD_RUNNABLE;
+        threads[waiting[i]].wait_on = NULL;
+    }
+}
+
+static struct sched_thread *new_thread(void)
+{
+    int i;
+
+    for (i = 0; i < SCHED_MAX_THREADS; i++) {
+        if (threads[i].state == THREAD_FREE) {
+            memset(&threads[i], 0, sizeof(threads[i]));
+            sem_init(&threads[i].wake, 0, 0);
+            nb_threads = FFMAX(nb_threads, i + 1);
+            return &threads[i];
+        }
+    }
+    return NULL;
+}
+
+static void *thread_start(void *arg)
+{
+    struct sched_thread *me = arg;
+    void *ret;
+
+    self = me;
+    while (sem_wait(&me->wake) < 0 && errno == EINTR)
+        ;
+    ret = me->start(me->arg);
+
+    me->state = THREAD_DONE;
+    wake(me, 1);
+    reschedule(me);
+    return ret;
+}
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                   void *(*start)(void *), void *arg)
+{
+    struct sched_thread *me, *t;
+    int ret;
+
+    resolve();
+    me = self;
+    if (!enabled || !in_window || !me)
+        return real_create(thread, attr, start, arg);
+    t = new_thread();
+    if (!t)
+        return EAGAIN;
+    t->start = start;
+    t->arg   = arg;
+    ret = real_create(&t->id, attr, thread_start, t);
+    if (ret) {
+        sem_destroy(&t->wake);
+        t->state = THREAD_FREE;
+        return ret;
+    }
+    *thread  = t->id;
+    t->state = THREAD_RUNNABLE;
+    reschedule(me);
+    return 0;
+}
+
+int pthread_join(pthread_t thread, void **retval)
+{
+    struct sched_thread *me, *t = NULL;
+    int ret, i;
+
+    resolve();
+    me = self;
+    if (enabled && me)
+        for (i = 0; i < nb_threads && !t; i++)
+            if (threads[i].state != THREAD_FREE && &threads[i] != me &&
+                pthread_equal(threads[i].id, thread))
+                t = &threads[i];
+    if (!t)
+        return real_join(thread, retval);
+
+    while (t->state != THREAD_DONE)
+        block(me, t);
+    ret = real_join(thread, retval);
+    sem_destroy(&t->wake);
+    t->state = THREAD_FREE;
+    return ret;
+}
+
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
+{
+    struct sched_object *obj = managed(mutex);
+
+    if (obj)
+        obj->owner = NULL;
+    return real_mutex_init(mutex, attr);
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex)
+{
+    struct sched_object *obj;
+
+    resolve();
+    if (enabled && self && (obj = find_object(mutex, 0)))
+        obj->addr = OBJECT_DELETED;
+    return real_mutex_destroy(mutex);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+    struct sched_object *obj = managed(mutex);
+
+    if (!obj)
+        return real_mutex_lock(mutex);
+    reschedule(self);
+    while (obj->owner)
+        block(self, mutex);
+    obj->owner = self;
+    return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex)
+{
+    struct sched_object *obj = managed(mutex);
+
+    if (!obj)
+        return real_mutex_trylock(mutex);
+    reschedule(self);
+    if (obj->owner)
+        return EBUSY;
+    obj->owner = self;
+    return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+    struct sched_object *obj = managed(mutex);
+
+    if (!obj)
+        return real_mutex_unlock(mutex);
+    obj->owner = NULL;
+    wake(mutex, 1);
+    reschedule(self);
+    return 0;
+}
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+    managed(cond);
+    return real_cond_init(cond, attr);
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond)
+{
+    struct sched_object *obj;
+
+    resolve();
+    if (enabled && self && (obj = find_object(cond, 0)))
+        obj->addr = OBJECT_DELETED;
+    return real_cond_destroy(cond);
+}
+
+static int cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    struct sched_object *m = managed(mutex);
+
+    m->owner = NULL;
+    wake(mutex, 1);
+    block(self, cond);
+    while (m->owner)
+        block(self, mutex);
+    m->owner = self;
+    return 0;
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    if (!managed(cond) || !managed(mutex))
+        return real_cond_wait(cond, mutex);
+    return cond_wait(cond, mutex);
+}
+
+/* there is no time in a deterministic schedule, the wait never times out */
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                           const struct timespec *abstime)
+{
+    if (!managed(cond) || !managed(mutex))
+        return real_cond_timedwait(cond, mutex, abstime);
+    return cond_wait(cond, mutex);
+}
+
+int pthread_cond_signal(pthread_cond_t *cond)
+{
+    if (!managed(cond))
+        return real_cond_signal(cond);
+    wake(cond, 0);
+    reschedule(self);
+    return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond)
+{
+    if (!managed(cond))
+        return real_cond_broadcast(cond);
+    wake(cond, 1);
+    reschedule(self);
+    return 0;
+}
+
+int sched_init(void)
+{
+    struct sched_thread *me;
+
+    resolve();
+    me = new_thread();
+    me->id    = pthread_self();
+    me->state = THREAD_RUNNABLE;
+    self      = me;
+    enabled   = 1;
+    return 0;
+}
+
+void sched_begin(uint64_t seed)
+{
+    rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    in_window = 1;
+}
+
+void sched_end(void)
+{
+    in_window = 0;
+}
+
+#else
+
+int sched_init(void)
+{
+    fprintf(stderr, "Built without -DFFFUZZ_SCHED, cannot schedule threads\n");
+    return -1;
+}
+
+void sched_begin(uint64_t seed)
+{
+}
+
+void sched_end(void)
+{
+}
+
+#endif
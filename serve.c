@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Decode jobs served over a Unix socket (-M serve).
+ *
+ * Clients connect to a SOCK_SEQPACKET socket and send one message per job:
+ * the options as text, "key=value" pairs separated by spaces, with the input
+ * file descriptor (a memfd or another regular file) attached as SCM_RIGHTS.
+ * The keys are format, codec and threads (as -f, -c and -t), name (of the
+ * input in the log, "fd:<number>" by default), out (the output file, the
+ * server's output_file with the worker number appended by default) and
+ * timeout (seconds, SERVE_TIMEOUT by default, 0 for none). Each job is
+ * answered by one line:
+ *
+ *   status=ok|error ret=<decode_input_data() result> us=<wall time>
+ *   status=invalid reason=<why>
+ *   status=timeout
+ *   status=crash signal=<number>|exit=<status>
+ *
+ * A connection may carry any number of jobs, one at a time.
+ *
+ * The server forks its workers (SERVE_MAX_WORKERS at most) after registering
+ * the codecs, and hands each accepted connection to an idle one over its
+ * channel. Workers decode the mapped input in memory with the per-input path
+ * of the persistent loop. The server keeps a copy of every connection until
+ * its worker is done with it, so when a worker dies it answers the job that
+ * killed it, then forks a new worker. A job past its timeout is killed by
+ * the worker's alarm() and answered the same way.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <libavutil/avstring.h>
+#include <libavutil/dict.h>
+#include <libavutil/time.h>
+
+#include "fffuzz.h"
+
+#define SERVE_MAX_WORKERS 256
+#define SERVE_MAX_MESSAGE 4096
+#define SERVE_TIMEOUT     10    ///< seconds per job by default
+#define SERVE_MAX_TIMEOUT 3600
+
+struct worker {
+    pid_t pid;
+    int   channel;  ///< socketpair end the connections are passed on
+    int   client;   ///< server's copy of the connection being served, or -1
+};
+
+static volatile sig_atomic_t stopping;
+
+static void stop_handler(int sig)
+{
+    stopping = 1;
+}
+
+/* send buf with fd (if >= 0) attached */
+static int send_message(int sock, const void *buf, size_t size, int fd)
+{
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = { (void *)buf, size };
+    struct msghdr msg = { 0 };
+
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+    if (fd >= 0) {
+        struct cmsghdr *cmsg;
+        memset(&control, 0, sizeof(control));
+        msg.msg_control    = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    while (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0) {
+        if (errno != EINTR)
+            return -1;
+    }
+    return 0;
+}
+
+/* receive a message into buf, and the attached fd into *fd (-1 if none) */
+static ssize_t recv_message(int sock, void *buf, size_t size, int *fd)
+{
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = { buf, size };
+    struct msghdr msg = { 0 };
+    struct cmsghdr *cmsg;
+    ssize_t ret;
+
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    do {
+        ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (ret < 0 && errno == EINTR);
+
+    *fd = -1;
+    for (cmsg = CMSG_FIRSTHDR(&msg); ret >= 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    return ret;
+}
+
+static void reply(int client, const char *fmt, ...)
+{
+    char line[256];
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    send_message(client, line, FFMIN(len, (int)sizeof(line) - 1), -1);
+}
+
+/**
+ * Serve one job of client.
+ *
+ * @return 1 if served, 0 at the end of the connection
+ */
+static int serve_job(int client, int index, const char *dst_filename, serve_fn job)
+{
+    static uint8_t empty[1];
+    char message[SERVE_MAX_MESSAGE + 1], default_name[32], *default_dst = NULL;
+    AVDictionary *options = NULL;
+    AVDictionaryEntry *name, *out, *timeout;
+    uint8_t *data = MAP_FAILED;
+    struct stat st;
+    int64_t start;
+    ssize_t len;
+    char *tail;
+    long seconds = SERVE_TIMEOUT;
+    int fd, ret;
+
+    /* a job without options is an empty message, but still has the fd */
+    len = recv_message(client, message, SERVE_MAX_MESSAGE, &fd);
+    if (len < 0 || (!len && fd < 0))
+        return 0;
+    message[len] = 0;
+
+    if (fd < 0) {
+        reply(client, "status=invalid reason=no-input-fd\n");
+        return 1;
+    }
+    if (av_dict_parse_string(&options, message, "=", " \n", 0) < 0) {
+        reply(client, "status=invalid reason=options\n");
+        goto end;
+    }
+    timeout = av_dict_get(options, "timeout", NULL, 0);
+    if (timeout && ((seconds = strtol(timeout->value, &tail, 10)) < 0 ||
+                    seconds > SERVE_MAX_TIMEOUT || *tail || tail == timeout->value)) {
+        reply(client, "status=invalid reason=timeout\n");
+        goto end;
+    }
+    /* memfds are regular files too; pipes and sockets cannot be mapped */
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        (st.st_size && (data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)) {
+        reply(client, "status=invalid reason=input-fd\n");
+        goto end;
+    }
+
+    name = av_dict_get(options, "name", NULL, 0);
+    out  = av_dict_get(options, "out", NULL, 0);
+    snprintf(default_name, sizeof(default_name), "fd:%d", fd);
+    if (!out && !(default_dst = av_asprintf("%s.%d", dst_filename, index))) {
+        reply(client, "status=invalid reason=memory\n");
+        goto end;
+    }
+
+    start = av_gettime_relative();
+    alarm(seconds);
+    /* an empty input is still read from memory */
+    ret = job(name ? name->value : default_name, st.st_size ? data : empty, st.st_size,
+              out ? out->value : default_dst, options);
+    alarm(0);
+    reply(client, "status=%s ret=%d us=%"PRId64"\n", ret ? "error" : "ok", ret,
+          av_gettime_relative() - start);
+
+end:
+    if (data != MAP_FAILED)
+        munmap(data, st.st_size);
+    close(fd);
+    av_dict_free(&options);
+    av_free(default_dst);
+    return 1;
+}
+
+static void worker_main(int channel, int index, const char *dst_filename, serve_fn job)
+{
+    int client;
+    char done = 'd';
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    /* the server going away closes the channel */
+    while (recv_message(channel, &done, 1, &client) > 0) {
+        if (client < 0)
+            continue;
+        while (serve_job(client, index, dst_filename, job))
+            ;
+        close(client);
+        if (write(channel, &done, 1) != 1)
+            break;
+    }
+    _exit(0);
+}
+
+static int spawn_worker(struct worker *workers, int nb_workers, int index,
+                        int listen_fd, const char *dst_filename, serve_fn job)
+{
+    struct worker *w = &workers[index];
+    int channel[2], i;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, channel) < 0) {
+        fprintf(stderr, "Could not create worker channel (%s)\n", strerror(errno));
+        return -1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    w->pid = fork();
+    if (w->pid < 0) {
+        fprintf(stderr, "Could not fork worker (%s)\n", strerror(errno));
+        close(channel[0]);
+        close(channel[1]);
+        return -1;
+    }
+    if (!w->pid) {
+        /* only its own channel end */
+        close(listen_fd);
+        close(channel[0]);
+        for (i = 0; i < nb_workers; i++) {
+            if (i == index)
+                continue;
+            if (workers[i].channel >= 0)
+                close(workers[i].channel);
+            if (workers[i].client >= 0)
+                close(workers[i].client);
+        }
+        worker_main(channel[1], index, dst_filename, job);
+    }
+    close(channel[1]);
+    w->channel = channel[0];
+    w->client  = -1;
+    return 0;
+}
+
+/* wait for a worker whose channel closed, and answer its job */
+static void reap_worker(struct worker *w)
+{
+    int status;
+
+    while (waitpid(w->pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    if (w->client >= 0) {
+        /* the job ran into the alarm() set by serve_job() */
+        if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM)
+            reply(w->client, "status=timeout\n");
+        else if (WIFSIGNALED(status))
+            reply(w->client, "status=crash signal=%d\n", WTERMSIG(status));
+        else
+            reply(w->client, "status=crash exit=%d\n", WEXITSTATUS(status));
+        close(w->client);
+    }
+    fprintf(stderr, "Worker %d exited (status 0x%x), forking a new one\n", (int)w->pid, status);
+    close(w->channel);
+    w->pid     = -1;
+    w->channel = -1;
+    w->client  = -1;
+}
+
+int serve(const char *socket_path, int nb_workers, const char *dst_filename, serve_fn job)
+{
+    struct worker workers[SERVE_MAX_WORKERS];
+    struct pollfd fds[SERVE_MAX_WORKERS + 1];
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct sigaction action = { 0 };
+    int listen_fd, i, ret = 1;
+
+    nb_workers = av_clip(nb_workers, 1, SERVE_MAX_WORKERS);
+    for (i = 0; i < nb_workers; i++) {
+        workers[i].pid     = -1;
+        workers[i].channel = -1;
+        workers[i].client  = -1;
+    }
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long\n", socket_path);
+        return 1;
+    }
+    av_strlcpy(addr.sun_path, socket_path, sizeof(addr.sun_path));
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    unlink(socket_path);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, SOMAXCONN) < 0) {
+        fprintf(stderr, "Could not listen on %s (%s)\n", socket_path, strerror(errno));
+        goto end;
+    }
+
+    /* no SA_RESTART, so poll() returns */
+    action.sa_handler = stop_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (i = 0; i < nb_workers; i++)
+        if (spawn_worker(workers, nb_workers, i, listen_fd, dst_filename, job) < 0)
+            goto end;
+    printf("Serving decode jobs on %s with %d workers\n", socket_path, nb_workers);
+    fflush(stdout);
+
+    while (!stopping) {
+        int nb_idle = 0, nb_fds = 0;
+
+        for (i = 0; i < nb_workers; i++) {
+            fds[nb_fds].fd     = workers[i].channel;
+            fds[nb_fds++].events = POLLIN;
+            nb_idle += workers[i].client < 0;
+        }
+        /* connections wait in the backlog while all workers are busy */
+        fds[nb_fds].fd     = nb_idle ? listen_fd : -1;
+        fds[nb_fds++].events = POLLIN;
+        if (poll(fds, nb_fds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "poll() failed (%s)\n", strerror(errno));
+            goto end;
+        }
+
+        for (i = 0; i < nb_workers; i++) {
+            struct worker *w = &workers[i];
+            ssize_t len;
+            char done;
+
+            if (!fds[i].revents)
+                continue;
+            len = read(w->channel, &done, 1);
+            if (len < 0 && errno == EINTR)
+                continue;
+            if (len == 1) {
+                close(w->client);
+                w->client = -1;
+                continue;
+            }
+            reap_worker(w);
+            if (spawn_worker(workers, nb_workers, i, listen_fd, dst_filename, job) < 0)
+                goto end;
+        }
+
+        if (fds[nb_workers].revents & POLLIN) {
+            int client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (client < 0)
+                continue;
+            for (i = 0; workers[i].client >= 0; i++)
+                ;
+            if (send_message(workers[i].channel, "c", 1, client) < 0) {
+                close(client);
+                continue;
+            }
+            workers[i].client = client;
+        }
+    }
+    ret = 0;
+
+end:
+    for (i = 0; i < nb_workers; i++) {
+        if (workers[i].pid > 0) {
+            kill(workers[i].pid, SIGTERM);
+            waitpid(workers[i].pid, NULL, 0);
+        }
+        if (workers[i].channel >= 0)
+            close(workers[i].channel);
+        if (workers[i].client >= 0)
+            close(workers[i].client);
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path);
+    }
+    return ret;
+}
@@ -0,0 +1,114 @@
+#!/bin/sh
+# Print the FFmpeg source files behind a -f/-c target: the objects the
+# Makefiles build for its demuxer, decoder and parser, and for everything
+# configure selects for them (DSP, bitstream readers, ...), arch directories
+# included. A component without Makefile objects falls back to the files
+# sharing the stem of its defining file (h264.c brings in h264_cabac.c,
+# x86/h264_qpel.c, ...). Encoders are left out.
+#
+# usage: sources.sh ffmpeg_src [-f format] [-c codec]
+
+if [ $# -lt 1 ] || [ ! -d "$1/libavcodec" ]; then
+    echo "usage: $0 ffmpeg_src [-f format] [-c codec]" >&2
+    exit 1
+fi
+
+src=$(cd "$1" && pwd)
+shift
+format=
+codec=
+while [ $# -gt 1 ]; do
+    case "$1" in
+    -f) format=$2 ;;
+    -c) codec=$2 ;;
+    esac
+    shift 2
+done
+
+# components (h264_decoder, mov_demuxer) of lib whose .name lists $3
+components() {
+    awk -v kind="$2" -v name="$3" '
+        match($0, "ff_[a-z0-9_]+_" kind "[[:space:]]*=") {
+            component = substr($0, RSTART + 3, RLENGTH - 3)
+            sub("[[:space:]]*=$", "", component)
+        }
+        component != "" && /\.name[[:space:]]*=/ && match($0, "\"[^\"]*\"") {
+            n = split(substr($0, RSTART + 1, RLENGTH - 2), names, ",")
+            for (i = 1; i <= n; i++)
+                if (names[i] == name)
+                    print component, FILENAME
+            component = ""
+        }' "$src/$1"/*.c
+}
+
+# the components and everything configure selects for them, recursively
+closure() {
+    todo="$*"
+    seen=
+    while set -- $todo && [ $# -gt 0 ]; do
+        component=$1
+        shift
+        todo="$*"
+        case " $seen " in
+        *" $component "*) continue ;;
+        esac
+        seen="$seen $component"
+        todo="$todo $(sed -n "s/^${component}_select=\"\(.*\)\"/\1/p" "$src/configure" 2>/dev/null)"
+    done
+    echo $seen
+}
+
+# sources of the OBJS-$(CONFIG_X) lines, continuations joined
+objects() {
+    config=$(echo "$1" | tr a-z A-Z)
+    for makefile in "$src"/lib*/Makefile "$src"/lib*/*/Makefile; do
+        [ -f "$makefile" ] || continue
+        lib=${makefile#$src/}
+        lib=${lib%%/*}
+        awk -v key="OBJS-\$(CONFIG_$config)" -v dir="$src/$lib/" '
+            {
+                line = $0
+                while (line ~ /\\$/ && (getline more) > 0)
+                    line = substr(line, 1, length(line) - 1) " " more
+                if (index(line, key) != 1)
+                    next
+                sub("^[^=]*=", "", line)
+                n = split(line, objs)
+                for (i = 1; i <= n; i++)
+                    if (objs[i] ~ /\.o$/)
+                        print dir substr(objs[i], 1, length(objs[i]) - 2) ".c"
+            }' "$makefile"
+    done
+}
+
+stem_files() {
+    stem=$(basename "$2" .c)
+    stem=${stem%dec}
+    ls "$1/$stem"*.c "$1"/*/"$stem"*.c 2>/dev/null
+}
+
+target_files() {
+    roots=
+    if [ -n "$codec" ]; then
+        components libavcodec decoder "$codec" > "$list"
+        [ -f "$src/libavcodec/${codec}_parser.c" ] && roots="${codec}_parser"
+    fi
+    [ -n "$format" ] && components libavformat demuxer "$format" >> "$list"
+    roots="$roots $(cut -d' ' -f1 "$list")"
+    [ -z "${roots# }" ] && return
+
+    for component in $(closure $roots); do
+        files=$(objects "$component")
+        if [ -z "$files" ]; then
+            file=$(grep "^$component " "$list" | cut -d' ' -f2)
+            [ -n "$file" ] && files=$(stem_files "$(dirname "$file")" "$file")
+        fi
+        for file in $files; do
+            [ -f "$file" ] && echo "$file"
+        done
+    done
+}
+
+list=$(mktemp) || exit 1
+target_files | grep -v 'enc\.c$' | sort -u
+rm -f "$list"
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Wall-clock time and hardware counters per harness stage.
+ *
+ * One perf_event_open() group (cycles, instructions, LLC misses, branch
+ * misses, dTLB load misses) counts the harness thread. Whenever the harness
+ * switches stage the group is read once and the difference is charged to
+ * the stage being left, so nested stages (output inside decode) are not
+ * counted twice.
+ * Counters the host does not have are reported as 0; if perf events are not
+ * available at all only wall-clock time is reported.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include <libavutil/time.h>
+
+#include "fffuzz.h"
+
+enum counter {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_LLC_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_DTLB_MISSES,
+    COUNTER_NB
+};
+
+struct stage_totals {
+    int64_t  wall_us;
+    uint64_t counters[COUNTER_NB];
+};
+
+static const char *const stage_names[STAGE_NB] = {
+    [STAGE_OPEN]   = "open",
+    [STAGE_PROBE]  = "probe",
+    [STAGE_DECODE] = "decode",
+    [STAGE_OUTPUT] = "output",
+};
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} counter_configs[COUNTER_NB] = {
+    [COUNTER_CYCLES]        = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [COUNTER_INSTRUCTIONS]  = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [COUNTER_LLC_MISSES]    = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    [COUNTER_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    [COUNTER_DTLB_MISSES]   = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                                PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+};
+
+static int enabled;
+static int group_fd = -1;
+static int nb_open;
+static int read_index[COUNTER_NB];  ///< position in the group read, -1 if not open
+
+static enum stage current_stage = STAGE_NONE;
+static int64_t last_wall_us;
+static uint64_t last_counters[COUNTER_NB];
+
+static struct stage_totals input_totals[STAGE_NB];
+static struct stage_totals run_totals[STAGE_NB];
+static int nb_inputs;
+
+static int open_counter(uint32_t type, uint64_t config, int leader)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.disabled       = leader < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                          PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+int stage_init(void)
+{
+    int i;
+
+    for (i = 0; i < COUNTER_NB; i++) {
+        int fd = open_counter(counter_configs[i].type, counter_configs[i].config, group_fd);
+        read_index[i] = -1;
+        if (fd < 0)
+            continue;
+        if (group_fd < 0)
+            group_fd = fd;
+        read_index[i] = nb_open++;
+    }
+    if (group_fd < 0)
+        fprintf(stderr, "Could not open perf events, only timing stages\n");
+    else
+        ioctl(group_fd, PERF_EVENT_IOC_ENABLE, 0);
+
+    enabled = 1;
+    last_wall_us = av_gettime_relative();
+    return 0;
+}
+
+static void read_counters(uint64_t counters[COUNTER_NB])
+{
+    /* nr, time_enabled, time_running, then one value per open counter */
+    uint64_t data[3 + COUNTER_NB];
+    int i;
+
+    memset(counters, 0, COUNTER_NB * sizeof(*counters));
+    if (group_fd < 0 || read(group_fd, data, sizeof(data)) < (ssize_t)(3 * sizeof(*data)))
+        return;
+    for (i = 0; i < COUNTER_NB; i++) {
+        if (read_index[i] < 0 || read_index[i] >= (int)data[0])
+            continue;
+        counters[i] = data[3 + read_index[i]];
+        /* scale up if the group was multiplexed with other users */
+        if (data[2] && data[2] < data[1])
+            counters[i] = (double)counters[i] * data[1] / data[2];
+    }
+}
+
+enum stage stage_enter(enum stage stage)
+{
+    enum stage previous = current_stage;
+    uint64_t counters[COUNTER_NB];
+    int64_t wall_us;
+    int i;
+
+    if (!enabled || stage == current_stage)
+        return previous;
+
+    wall_us = av_gettime_relative();
+    read_counters(counters);
+    if (current_stage != STAGE_NONE) {
+        input_totals[current_stage].wall_us += wall_us - last_wall_us;
+        for (i = 0; i < COUNTER_NB; i++)
+            input_totals[current_stage].counters[i] += counters[i] - last_counters[i];
+    }
+    last_wall_us = wall_us;
+    memcpy(last_counters, counters, sizeof(counters));
+    current_stage = stage;
+    return previous;
+}
+
+static void print_totals(FILE *report, const char *label, const char *name,
+                         const struct stage_totals *totals)
+{
+    int s;
+
+    for (s = 0; s < STAGE_NB; s++) {
+        const uint64_t *c = totals[s].counters;
+        fprintf(report, "%s:%s stage:%s wall_us:%"PRId64" cycles:%"PRIu64" instructions:%"PRIu64
+                " llc_misses:%"PRIu64" branch_misses:%"PRIu64" dtlb_misses:%"PRIu64" ipc:%.2f\n",
+                label, name, stage_names[s], totals[s].wall_us,
+                c[COUNTER_CYCLES], c[COUNTER_INSTRUCTIONS],
+                c[COUNTER_LLC_MISSES], c[COUNTER_BRANCH_MISSES], c[COUNTER_DTLB_MISSES],
+                c[COUNTER_CYCLES] ? (double)c[COUNTER_INSTRUCTIONS] / c[COUNTER_CYCLES] : 0.0);
+    }
+}
+
+void stage_report_input(FILE *report, const char *name)
+{
+    int s, i;
+
+    if (!enabled)
+        return;
+    stage_enter(STAGE_NONE);
+    print_totals(report, "input", name, input_totals);
+    for (s = 0; s < STAGE_NB; s++) {
+        run_totals[s].wall_us += input_totals[s].wall_us;
+        for (i = 0; i < COUNTER_NB; i++)
+            run_totals[s].counters[i] += input_totals[s].counters[i];
+    }
+    memset(input_totals, 0, sizeof(input_totals));
+    nb_inputs++;
+}
+
+void stage_report_run(FILE *report)
+{
+    char name[32];
+
+    if (!enabled)
+        return;
+    snprintf(name, sizeof(name), "%d_inputs", nb_inputs);
+    print_totals(report, "run", name, run_totals);
+}
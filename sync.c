@@ -0,0 +1,563 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Corpus sync between the AFL instances of a fleet through shared memory.
+ *
+ * The fleet shares one POSIX shared memory object: a header, a table of the
+ * content hashes seen so far and an append-only log of queue entries. Each
+ * AFL instance runs with its own output directory (-o out_dir -S name) and
+ * one "run" helper next to it, which
+ *
+ *  - watches out_dir/name/queue with inotify and appends every new entry
+ *    whose hash it claims first in the table, so each input is logged once;
+ *  - copies the entries other instances logged into out_dir/SYNC_DIR_NAME/
+ *    queue, with increasing ids, which AFL syncs from as from any other
+ *    instance directory.
+ *
+ * AFL then only scans its own output directory, with one foreign queue in
+ * it, instead of the queues of the whole fleet.
+ *
+ * Appending reserves the record by storing its length at the tail with a
+ * compare and swap, so a record is never reserved without a length, then
+ * copies the entry and commits the record last. Whoever finds a length at
+ * the tail moves the tail past it, so a writer killed right after the
+ * reservation does not hold the tail back. Readers stop at the first
+ * uncommitted record and retry it on the next round. A record still
+ * uncommitted after SYNC_ABANDON_MS, left by a helper killed while copying,
+ * is marked abandoned and skipped by all readers; its writer then counts
+ * the entry as dropped. Once the log is full new entries are only
+ * deduplicated, not shared.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define SYNC_MAGIC     "FFSYNC"
+#define SYNC_VERSION   3
+#define SYNC_DIR_NAME  "fleet-sync"
+#define SYNC_MAX_ENTRY (1 << 20)    ///< AFL's MAX_FILE
+#define SYNC_INTERVAL  1000         ///< ms between log reads without queue events
+#define SYNC_ABANDON_MS 10000       ///< after which an uncommitted record is skipped
+
+enum record_state {
+    SYNC_RECORD_WRITING,    ///< reserved, the entry is being copied
+    SYNC_RECORD_COMMITTED,
+    SYNC_RECORD_ABANDONED,  ///< given up on by a reader
+};
+
+struct sync_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t nb_slots;      ///< hash table size, a power of 2
+    uint64_t log_size;      ///< bytes of the record area
+    uint64_t tail;          ///< bytes reserved in it, may lag the last reservation
+    uint64_t nb_records;
+    uint64_t nb_duplicates;
+    uint64_t nb_dropped;    ///< new entries which did not fit
+};
+
+/* followed by size bytes of the entry, padded to 8 */
+struct sync_record {
+    uint32_t state;         ///< enum record_state
+    uint32_t size;
+    uint32_t origin;        ///< hash of the instance name
+    uint32_t length;        ///< of the whole record, 0 while free; storing it reserves the record
+    uint64_t hash;
+};
+
+struct sync_log {
+    struct sync_header *header;
+    uint64_t *slots;
+    uint8_t  *records;
+    size_t    map_size;
+};
+
+static uint64_t hash_data(const uint8_t *data, size_t size)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        h = (h ^ data[i]) * 0x100000001b3ULL;
+    /* 0 marks an empty slot */
+    return h ? h : 1;
+}
+
+static uint64_t record_length(uint32_t size)
+{
+    return (sizeof(struct sync_record) + size + 7) & ~7ULL;
+}
+
+static int open_log(struct sync_log *log, const char *shm_name, uint64_t log_size)
+{
+    struct sync_header *header;
+    struct stat st;
+    int fd, create = log_size > 0;
+    uint32_t nb_slots = 1024;
+
+    fd = shm_open(shm_name, O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0600);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open shared memory %s (%s)\n", shm_name, strerror(errno));
+        return -1;
+    }
+    if (create) {
+        /* one slot per 512 bytes of log */
+        while (nb_slots < log_size / 512 && nb_slots < 1U << 31)
+            nb_slots *= 2;
+        st.st_size = sizeof(*header) + nb_slots * sizeof(uint64_t) + log_size;
+        if (ftruncate(fd, st.st_size) < 0) {
+            fprintf(stderr, "Could not size shared memory %s (%s)\n", shm_name, strerror(errno));
+            close(fd);
+            shm_unlink(shm_name);
+            return -1;
+        }
+    } else if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*header)) {
+        fprintf(stderr, "Shared memory %s is not a sync log\n", shm_name);
+        close(fd);
+        return -1;
+    }
+    header = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        fprintf(stderr, "Could not map shared memory %s (%s)\n", shm_name, strerror(errno));
+        return -1;
+    }
+    if (create) {
+        header->version  = SYNC_VERSION;
+        header->nb_slots = nb_slots;
+        header->log_size = log_size;
+        /* the magic last, the others check it */
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(header->magic, SYNC_MAGIC, sizeof(SYNC_MAGIC));
+    } else if (memcmp(header->magic, SYNC_MAGIC, sizeof(SYNC_MAGIC)) ||
+               header->version != SYNC_VERSION ||
+               st.st_size != (off_t)(sizeof(*header) + header->nb_slots * sizeof(uint64_t) +
+                                     header->log_size)) {
+        fprintf(stderr, "Shared memory %s is not a sync log\n", shm_name);
+        munmap(header, st.st_size);
+        return -1;
+    }
+    log->header   = header;
+    log->slots    = (uint64_t *)(header + 1);
+    log->records  = (uint8_t *)(log->slots + header->nb_slots);
+    log->map_size = st.st_size;
+    return 0;
+}
+
+/**
+ * Enter hash in the table.
+ *
+ * @return 1 if it was new, 0 if already there, -1 if the table is full
+ */
+static int claim_hash(struct sync_log *log, uint64_t hash)
+{
+    uint32_t mask = log->header->nb_slots - 1, slot = hash & mask, i;
+
+    for (i = 0; i <= mask; i++, slot = (slot + 1) & mask) {
+        uint64_t expected = 0;
+        if (__atomic_compare_exchange_n(&log->slots[slot], &expected, hash, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return 1;
+        if (expected == hash)
+            return 0;
+    }
+    return -1;
+}
+
+/* move the tail past the records reserved at it and return it */
+static uint64_t settle_tail(struct sync_log *log)
+{
+    struct sync_header *header = log->header;
+    uint64_t tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+
+    while (tail + sizeof(struct sync_record) <= header->log_size) {
+        struct sync_record *record = (void *)(log->records + tail);
+        uint32_t length = __atomic_load_n(&record->length, __ATOMIC_ACQUIRE);
+
+        if (!length)
+            break;
+        /* on failure tail is reloaded with where another process moved it */
+        if (__atomic_compare_exchange_n(&header->tail, &tail, tail + length, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            tail += length;
+    }
+    return tail;
+}
+
+static int append(struct sync_log *log, const uint8_t *data, uint32_t size, uint32_t origin)
+{
+    struct sync_header *header = log->header;
+    uint64_t hash = hash_data(data, size), offset;
+    uint32_t length = record_length(size), free_length;
+    struct sync_record *record;
+    uint32_t state = SYNC_RECORD_WRITING;
+    int ret = claim_hash(log, hash);
+
+    if (!ret) {
+        __atomic_fetch_add(&header->nb_duplicates, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    if (ret < 0) {
+        __atomic_fetch_add(&header->nb_dropped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    do {
+        offset = settle_tail(log);
+        if (offset + length > header->log_size) {
+            __atomic_fetch_add(&header->nb_dropped, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+        record      = (struct sync_record *)(log->records + offset);
+        free_length = 0;
+        /* readers can skip the record from here on */
+    } while (!__atomic_compare_exchange_n(&record->length, &free_length, length, 0,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    settle_tail(log);
+    record->size   = size;
+    record->origin = origin;
+    record->hash   = hash;
+    memcpy(record + 1, data, size);
+    if (!__atomic_compare_exchange_n(&record->state, &state, SYNC_RECORD_COMMITTED, 0,
+                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&header->nb_dropped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    __atomic_fetch_add(&header->nb_records, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+static uint32_t hash_name(const char *name)
+{
+    uint64_t h = hash_data((const uint8_t *)name, strlen(name));
+    return h ^ h >> 32;
+}
+
+/* state of one run helper */
+struct instance {
+    struct sync_log log;
+    uint32_t origin;
+    char    *queue_dir;     ///< of the AFL instance
+    char    *sync_dir;      ///< queue AFL syncs from
+    char    *state_path;    ///< cursor and next id, kept across restarts
+    uint64_t cursor;        ///< next record to read
+    uint64_t wait_cursor;   ///< uncommitted record waited for
+    int64_t  wait_start;    ///< ms when first found uncommitted
+    uint32_t next_id;       ///< of the next entry in sync_dir
+    int      nb_published, nb_injected;
+};
+
+/* log one entry of the instance's queue, unless AFL synced it from us */
+static void publish(struct instance *in, const char *name)
+{
+    char path[PATH_MAX];
+    uint8_t *data = NULL;
+    struct stat st;
+    int fd;
+
+    if (strncmp(name, "id:", 3) || strstr(name, ",sync:"))
+        return;
+    snprintf(path, sizeof(path), "%s/%s", in->queue_dir, name);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size <= SYNC_MAX_ENTRY) {
+        if (!st.st_size)
+            in->nb_published += append(&in->log, (const uint8_t *)"", 0, in->origin);
+        else if ((data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+            in->nb_published += append(&in->log, data, st.st_size, in->origin);
+            munmap(data, st.st_size);
+        }
+    }
+    close(fd);
+}
+
+static void publish_queue(struct instance *in)
+{
+    DIR *dir = opendir(in->queue_dir);
+    struct dirent *entry;
+
+    if (!dir)
+        return;
+    while ((entry = readdir(dir)))
+        publish(in, entry->d_name);
+    closedir(dir);
+}
+
+static int write_entry(struct instance *in, const struct sync_record *record)
+{
+    char tmp_path[PATH_MAX], path[PATH_MAX];
+    FILE *file;
+    int written;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s/.entry", in->sync_dir);
+    snprintf(path, sizeof(path), "%s/id:%06u,fleet:%08x", in->sync_dir,
+             in->next_id, record->origin);
+    file = fopen(tmp_path, "wb");
+    if (!file)
+        return -1;
+    written = fwrite(record + 1, 1, record->size, file) == record->size;
+    if (fclose(file) || !written || rename(tmp_path, path) < 0) {
+        fprintf(stderr, "Could not write %s (%s)\n", path, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+    in->next_id++;
+    return 0;
+}
+
+/* written to a temporary file and renamed, so a restart never reads half of it */
+static void write_state(const struct instance *in)
+{
+    char tmp_path[PATH_MAX];
+    FILE *state;
+    int written;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", in->state_path);
+    state = fopen(tmp_path, "w");
+    if (!state) {
+        fprintf(stderr, "Could not write %s (%s)\n", tmp_path, strerror(errno));
+        return;
+    }
+    written = fprintf(state, "%"PRIu64" %u\n", in->cursor, in->next_id) > 0;
+    if (fclose(state) || !written || rename(tmp_path, in->state_path) < 0) {
+        fprintf(stderr, "Could not write %s (%s)\n", in->state_path, strerror(errno));
+        unlink(tmp_path);
+    }
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* whether the uncommitted record at the cursor was waited for long enough */
+static int wait_expired(struct instance *in)
+{
+    if (in->wait_start < 0 || in->wait_cursor != in->cursor) {
+        in->wait_cursor = in->cursor;
+        in->wait_start  = now_ms();
+        return 0;
+    }
+    return now_ms() - in->wait_start >= SYNC_ABANDON_MS;
+}
+
+/* copy the committed records of other instances since the cursor */
+static void inject(struct instance *in)
+{
+    uint64_t end = settle_tail(&in->log), cursor;
+
+    /* the log was created again, the ids go on */
+    if (in->cursor > end)
+        in->cursor = 0;
+    cursor = in->cursor;
+    while (in->cursor + sizeof(struct sync_record) <= end) {
+        struct sync_record *record = (void *)(in->log.records + in->cursor);
+        uint32_t length = __atomic_load_n(&record->length, __ATOMIC_ACQUIRE);
+        uint32_t state  = __atomic_load_n(&record->state, __ATOMIC_ACQUIRE);
+
+        /* every record below the tail has its length */
+        if (length < sizeof(*record) || in->cursor + length > end)
+            break;
+        if (state == SYNC_RECORD_WRITING) {
+            if (!wait_expired(in))
+                break;
+            /* the writer may have committed it meanwhile, then look again */
+            if (!__atomic_compare_exchange_n(&record->state, &state, SYNC_RECORD_ABANDONED,
+                                             0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+                continue;
+            fprintf(stderr, "Skipping record %"PRIu64", uncommitted for %d ms\n",
+                    in->cursor, SYNC_ABANDON_MS);
+            state = SYNC_RECORD_ABANDONED;
+        }
+        if (state == SYNC_RECORD_COMMITTED && record->origin != in->origin) {
+            if (write_entry(in, record) < 0)
+                break;
+            in->nb_injected++;
+        }
+        in->cursor += length;
+    }
+    if (in->cursor != cursor)
+        write_state(in);
+}
+
+static int make_dir(const char *path)
+{
+    if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create %s (%s)\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int run(const char *shm_name, const char *out_dir, const char *name, int interval)
+{
+    struct instance in = { .origin = hash_name(name), .wait_start = -1 };
+    char path[PATH_MAX];
+    int inotify_fd, watch = -1, ret = 1;
+    FILE *state;
+
+    if (open_log(&in.log, shm_name, 0) < 0)
+        return 1;
+    in.queue_dir  = malloc(PATH_MAX);
+    in.sync_dir   = malloc(PATH_MAX);
+    in.state_path = malloc(PATH_MAX);
+    if (!in.queue_dir || !in.sync_dir || !in.state_path) {
+        fprintf(stderr, "Out of memory\n");
+        goto end;
+    }
+    snprintf(in.queue_dir, PATH_MAX, "%s/%s/queue", out_dir, name);
+    snprintf(path, sizeof(path), "%s/" SYNC_DIR_NAME, out_dir);
+    snprintf(in.sync_dir, PATH_MAX, "%s/" SYNC_DIR_NAME "/queue", out_dir);
+    snprintf(in.state_path, PATH_MAX, "%s/" SYNC_DIR_NAME "/.state", out_dir);
+    if (make_dir(out_dir) < 0 || make_dir(path) < 0 || make_dir(in.sync_dir) < 0)
+        goto end;
+
+    state = fopen(in.state_path, "r");
+    if (state) {
+        if (fscanf(state, "%"SCNu64" %u", &in.cursor, &in.next_id) != 2)
+            in.cursor = in.next_id = 0;
+        fclose(state);
+    }
+
+    inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd < 0) {
+        fprintf(stderr, "Could not start inotify (%s)\n", strerror(errno));
+        goto end;
+    }
+    printf("Syncing %s (origin %08x) through %s from record %"PRIu64"\n",
+           in.queue_dir, in.origin, shm_name, in.cursor);
+    fflush(stdout);
+
+    for (;;) {
+        struct pollfd pfd = { inotify_fd, POLLIN, 0 };
+        char events[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+
+        /* AFL creates the queue after its dry run, entries before the watch
+         * are picked up by a scan */
+        if (watch < 0) {
+            watch = inotify_add_watch(inotify_fd, in.queue_dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (watch >= 0)
+                publish_queue(&in);
+        }
+        if (poll(&pfd, 1, interval) < 0 && errno != EINTR)
+            break;
+        while ((len = read(inotify_fd, events, sizeof(events))) > 0) {
+            char *p;
+            for (p = events; p < events + len; ) {
+                struct inotify_event *event = (struct inotify_event *)p;
+                if (event->mask & IN_IGNORED)
+                    watch = -1;
+                else if (event->len)
+                    publish(&in, event->name);
+                p += sizeof(*event) + event->len;
+            }
+        }
+        inject(&in);
+    }
+    fprintf(stderr, "poll() failed (%s)\n", strerror(errno));
+    close(inotify_fd);
+
+end:
+    free(in.queue_dir);
+    free(in.sync_dir);
+    free(in.state_path);
+    munmap(in.log.header, in.log.map_size);
+    return ret;
+}
+
+static int print_stats(const char *shm_name)
+{
+    struct sync_log log;
+    struct sync_header *header;
+    uint64_t tail;
+
+    if (open_log(&log, shm_name, 0) < 0)
+        return 1;
+    header = log.header;
+    tail = settle_tail(&log);
+    printf("records:%"PRIu64" duplicates:%"PRIu64" dropped:%"PRIu64
+           " used:%"PRIu64" size:%"PRIu64" slots:%u\n",
+           header->nb_records, header->nb_duplicates, header->nb_dropped,
+           tail, header->log_size,
+           header->nb_slots);
+    munmap(header, log.map_size);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 4 && !strcmp(argv[1], "init")) {
+        struct sync_log log;
+        int size_mb = atoi(argv[3]);
+        if (size_mb < 1 || size_mb > 65536) {
+            fprintf(stderr, "The log size has to be 1 to 65536 MB\n");
+            return 1;
+        }
+        if (open_log(&log, argv[2], (uint64_t)size_mb << 20) < 0)
+            return 1;
+        munmap(log.header, log.map_size);
+        return 0;
+    }
+    if ((argc == 5 || argc == 6) && !strcmp(argv[1], "run")) {
+        int interval = argc == 6 ? atoi(argv[5]) : SYNC_INTERVAL;
+        if (interval < 10) {
+            fprintf(stderr, "The interval has to be 10 ms at least\n");
+            return 1;
+        }
+        return run(argv[2], argv[3], argv[4], interval);
+    }
+    if (argc == 3 && !strcmp(argv[1], "stats"))
+        return print_stats(argv[2]);
+    if (argc == 3 && !strcmp(argv[1], "remove"))
+        return shm_unlink(argv[2]) < 0;
+
+    fprintf(stderr, "\n"
+                "usage: %s init shm_name size_mb\n"
+                "       %s run shm_name out_dir name [interval_ms]\n"
+                "       %s stats|remove shm_name\n\n"
+                "Shares the queue entries of the AFL instances of a fleet through\n"
+                "an append-only log in the shared memory object shm_name (e.g.\n"
+                "/fffuzz). Run one helper per instance, next to\n"
+                "afl-fuzz -o out_dir -S name; it logs the new entries of the\n"
+                "instance and copies those of the others to out_dir/" SYNC_DIR_NAME "\n"
+                "for AFL to sync from.\n\n",
+                argv[0], argv[0], argv[0]);
+    return 1;
+}
@@ -0,0 +1,100 @@
+#!/bin/sh
+# Cut a crashing input right after the packet it crashed in, then minimize
+# the rest with afl-tmin. The packet comes from the "fffuzz crash:" line the
+# harness prints from its signal handler. A crash in an archive or batch
+# entry (-a) is first cut down to that entry; deflated zip entries are
+# extracted with unzip by the name the harness prints.
+#
+# usage: triage.sh crash_file output_file [fffuzz options]
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 crash_file output_file [fffuzz options]" >&2
+    exit 1
+fi
+
+crash_file=$1
+output_file=$2
+shift 2
+fffuzz=${FFFUZZ:-./fffuzz}
+truncated=$output_file.truncated
+
+crash_line() {
+    "$fffuzz" "$@" /dev/null 2>&1 >/dev/null | grep '^fffuzz crash:' | tail -n 1
+}
+
+line=$(crash_line "$@" "$crash_file")
+if [ -z "$line" ]; then
+    echo "$crash_file does not crash" >&2
+    exit 1
+fi
+echo "$line"
+
+# a crash inside an archive or batch (-a) entry: cut the entry out and go on
+# with it alone, without -a
+fields=$(printf '%s\n' "$line" | sed 's/ name:.*//')
+offset=$(echo "$fields" | sed -n 's/.* offset:\(-*[0-9]*\).*/\1/p')
+length=$(echo "$fields" | sed -n 's/.* length:\(-*[0-9]*\).*/\1/p')
+if [ -n "$offset" ]; then
+    entry=$output_file.entry
+    if [ "$offset" -ge 0 ]; then
+        tail -c +$((offset + 1)) "$crash_file" | head -c "$length" > "$entry"
+        where="at offset $offset"
+    else
+        # decompressed, so pos is not an offset into the archive; the name
+        # comes last, after the numeric fields
+        name=$(printf '%s\n' "$line" |
+            sed -n 's/^fffuzz crash:\( [a-z_]*:-*[0-9]*\)* name://p')
+        # unzip takes the name as a pattern
+        pattern=$(printf '%s\n' "$name" | sed 's/[][*?\\]/\\&/g')
+        if [ -z "$name" ] || ! unzip -p "$crash_file" "$pattern" > "$entry" 2>/dev/null ||
+           [ "$(wc -c < "$entry")" -ne "$length" ]; then
+            echo "Could not extract the crashing entry ${name:+$name }of $crash_file," \
+                "extract it by hand and triage it without -a" >&2
+            rm -f "$entry"
+            exit 1
+        fi
+        where="named $name"
+    fi
+    skip=
+    for arg do
+        shift
+        if [ -n "$skip" ]; then
+            skip=
+            continue
+        fi
+        if [ "$arg" = -a ]; then
+            skip=1
+            continue
+        fi
+        set -- "$@" "$arg"
+    done
+    entry_line=$(crash_line "$@" "$entry")
+    if [ -z "$entry_line" ]; then
+        echo "Entry $where does not crash alone, keep the archive" >&2
+        rm -f "$entry"
+        exit 1
+    fi
+    echo "Crashing entry is $length bytes $where"
+    crash_file=$entry
+    line=$entry_line
+fi
+
+pos=$(echo "$line" | sed -n 's/.* pos:\(-*[0-9]*\).*/\1/p')
+size=$(echo "$line" | sed -n 's/.* size:\(-*[0-9]*\).*/\1/p')
+
+cp "$crash_file" "$truncated"
+if [ "$pos" -ge 0 ] 2>/dev/null; then
+    head -c $((pos + size)) "$crash_file" > "$truncated"
+    # the demuxer may need more than the packet itself to get there
+    if [ -z "$(crash_line "$@" "$truncated")" ]; then
+        echo "Truncated input no longer crashes, minimizing all of it" >&2
+        cp "$crash_file" "$truncated"
+    else
+        echo "Truncated $crash_file to $((pos + size)) bytes"
+    fi
+fi
+
+afl-tmin -i "$truncated" -o "$output_file" -- "$fffuzz" "$@" @@ /dev/null
+ret=$?
+rm -f "$truncated" "$output_file.entry"
+exit $ret
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2026 The fffuzz authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file
+ * Raw output written on a separate thread.
+ *
+ * The decoder thread only takes a new reference to each frame and queues it;
+ * the writer thread gathers the visible rows straight out of the frame
+ * buffers with pwritev() and drops the reference once they are on disk. At
+ * most WRITER_DEPTH frames are queued or being written, after that the
+ * decoder waits. The file gets the same bytes as the stdio output.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/samplefmt.h>
+
+#include "fffuzz.h"
+
+#define WRITER_DEPTH 8
+#define WRITER_IOV   64
+
+struct writer {
+    int fd;
+    off_t offset;
+    int error;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    AVFrame *queue[WRITER_DEPTH];
+    enum AVMediaType types[WRITER_DEPTH];
+    int head, nb_queued;    ///< nb_queued includes the frame being written
+    int closing;
+};
+
+struct iov_batch {
+    struct iovec iov[WRITER_IOV];
+    int nb;
+};
+
+/* write out the batch, however short pwritev() is each time */
+static int flush_batch(struct writer *w, struct iov_batch *batch)
+{
+    struct iovec *iov = batch->iov;
+    int nb = batch->nb;
+
+    while (nb > 0) {
+        ssize_t written = pwritev(w->fd, iov, nb, w->offset);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        w->offset += written;
+        while (nb > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            nb--;
+        }
+        if (nb > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    batch->nb = 0;
+    return 0;
+}
+
+static int add_iov(struct writer *w, struct iov_batch *batch, const uint8_t *data, size_t size)
+{
+    if (!size)
+        return 0;
+    if (batch->nb == WRITER_IOV && flush_batch(w, batch) < 0)
+        return -1;
+    batch->iov[batch->nb].iov_base = (void *)data;
+    batch->iov[batch->nb].iov_len  = size;
+    batch->nb++;
+    return 0;
+}
+
+static int write_frame(struct writer *w, const AVFrame *frame, enum AVMediaType type)
+{
+    struct iov_batch batch;
+    int p, y;
+
+    batch.nb = 0;
+    if (type == AVMEDIA_TYPE_VIDEO) {
+        /* the rawvideo layout av_image_copy() makes with align 1 */
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+        int linesizes[4];
+
+        if (!desc || av_image_fill_linesizes(linesizes, frame->format, frame->width) < 0)
+            return -1;
+        for (p = 0; p < 4 && frame->data[p]; p++) {
+            int h = frame->height;
+            if (p == 1 && (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_PSEUDOPAL))) {
+                if (add_iov(w, &batch, frame->data[1], 256 * 4) < 0)
+                    return -1;
+                break;
+            }
+            if (p == 1 || p == 2)
+                h = (h + (1 << desc->log2_chroma_h) - 1) >> desc->log2_chroma_h;
+            /* rows without padding are one contiguous block */
+            if (frame->linesize[p] == linesizes[p]) {
+                if (add_iov(w, &batch, frame->data[p], (size_t)linesizes[p] * h) < 0)
+                    return -1;
+                continue;
+            }
+            for (y = 0; y < h; y++)
+                if (add_iov(w, &batch, frame->data[p] + y * frame->linesize[p], linesizes[p]) < 0)
+                    return -1;
+        }
+    } else {
+        /* first plane only, like the stdio output */
+        if (add_iov(w, &batch, frame->extended_data[0],
+                    frame->nb_samples * av_get_bytes_per_sample(frame->format)) < 0)
+            return -1;
+    }
+    return flush_batch(w, &batch);
+}
+
+static void *writer_thread(void *arg)
+{
+    struct writer *w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        AVFrame *frame;
+        enum AVMediaType type;
+        int error = 0;
+
+        while (!w->nb_queued && !w->closing)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (!w->nb_queued)
+            break;
+        frame = w->queue[w->head];
+        type  = w->types[w->head];
+        pthread_mutex_unlock(&w->lock);
+
+        /* only this thread sets error, the callers read it locked */
+        if (!w->error && write_frame(w, frame, type) < 0)
+            error = errno ? errno : EIO;
+        av_frame_free(&frame);
+
+        pthread_mutex_lock(&w->lock);
+        if (error)
+            w->error = error;
+        w->head = (w->head + 1) % WRITER_DEPTH;
+        w->nb_queued--;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+struct writer *writer_open(int fd)
+{
+    struct writer *w = av_mallocz(sizeof(*w));
+
+    if (!w)
+        return NULL;
+    w->fd = fd;
+    w->offset = lseek(fd, 0, SEEK_CUR);
+    if (w->offset < 0)
+        w->offset = 0;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    if (pthread_create(&w->thread, NULL, writer_thread, w)) {
+        fprintf(stderr, "Could not start the output writer\n");
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+        av_free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int writer_write_frame(struct writer *w, const AVFrame *frame, enum AVMediaType type)
+{
+    AVFrame *ref = av_frame_clone(frame);
+
+    if (!ref)
+        return AVERROR(ENOMEM);
+    pthread_mutex_lock(&w->lock);
+    while (w->nb_queued == WRITER_DEPTH)
+        pthread_cond_wait(&w->cond, &w->lock);
+    if (w->error) {
+        /* reported by writer_close() */
+        pthread_mutex_unlock(&w->lock);
+        av_frame_free(&ref);
+        return AVERROR(EIO);
+    }
+    w->queue[(w->head + w->nb_queued) % WRITER_DEPTH] = ref;
+    w->types[(w->head + w->nb_queued) % WRITER_DEPTH] = type;
+    w->nb_queued++;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+int writer_close(struct writer **writer)
+{
+    struct writer *w = *writer;
+    int error;
+
+    if (!w)
+        return 0;
+    pthread_mutex_lock(&w->lock);
+    w->closing = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    error = w->error;
+    if (error)
+        fprintf(stderr, "Could not write output: %s\n", strerror(error));
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    av_freep(writer);
+    return error ? -1 : 0;
+}